@@ -0,0 +1,17 @@
+// ==========================================================================
+// Fragment program which adds a new frame to the running average of the
+// frames traced since the view last changed (temporal accumulation)
+// ==========================================================================
+#version 410
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+uniform sampler2D frame;
+uniform sampler2D history;
+uniform float weight;		// 1/(n+1) for the n+1th frame, 1 replaces the history
+
+void main(void){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	FragmentColour = mix(texelFetch(history, pixel, 0), texelFetch(frame, pixel, 0), weight);
+}
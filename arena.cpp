@@ -0,0 +1,102 @@
+// ==========================================================================
+// Bump allocator for per-tile scratch memory
+// ==========================================================================
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include "arena.h"
+
+namespace {
+
+//Per thread so render threads can report their own allocations
+thread_local size_t heapAllocations = 0;
+
+size_t alignUp(size_t value, size_t alignment){
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}
+
+size_t threadHeapAllocations(){
+	return heapAllocations;
+}
+
+//Counting replacements of the global allocation functions. Everything else
+//(array, nothrow and delete forms) is routed through these by the library.
+void *operator new(size_t size){
+	heapAllocations++;
+	void *memory = std::malloc(size ? size : 1);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void *memory) noexcept{
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept{
+	std::free(memory);
+}
+
+Arena::Arena(size_t blockSize)
+	: current(0), offset(0), used(0), blockSize(blockSize)
+{
+	counters.allocations = 0;
+	counters.resets = 0;
+	counters.peakBytes = 0;
+	counters.capacity = 0;
+	counters.blocks = 0;
+}
+
+Arena::~Arena(){
+	for (size_t i = 0; i < blocks.size(); i++)
+		std::free(blocks[i].data);
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment){
+	while (true){
+		if (current < blocks.size()){
+			Block &block = blocks[current];
+			uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+			size_t start = alignUp(base + offset, alignment) - base;
+			if (start + bytes <= block.size){
+				offset = start + bytes;
+				used += bytes;
+				if (used > counters.peakBytes)
+					counters.peakBytes = used;
+				counters.allocations++;
+				return block.data + start;
+			}
+			//Try the next block kept from an earlier tile before growing
+			if (current + 1 < blocks.size()){
+				current++;
+				offset = 0;
+				continue;
+			}
+		}
+
+		Block block;
+		block.size = (bytes + alignment > blockSize) ? bytes + alignment : blockSize;
+		block.data = static_cast<char *>(std::malloc(block.size));
+		if (!block.data)
+			throw std::bad_alloc();
+		blocks.push_back(block);
+		current = blocks.size() - 1;
+		offset = 0;
+		counters.capacity += block.size;
+		counters.blocks++;
+	}
+}
+
+void Arena::reset(){
+	current = 0;
+	offset = 0;
+	used = 0;
+	counters.resets++;
+}
+
+ArenaStats Arena::stats() const{
+	return counters;
+}
@@ -0,0 +1,61 @@
+// ==========================================================================
+// Bump allocator for per-tile scratch memory
+//
+// Each render thread owns one Arena and resets it after every tile. Memory
+// blocks are kept across resets, so once the first tiles have grown the arena
+// to its working size the render loop makes no heap allocations at all.
+// ==========================================================================
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+struct ArenaStats{
+	size_t allocations;		//Allocations served since construction
+	size_t resets;
+	size_t peakBytes;		//Largest amount in use between two resets
+	size_t capacity;		//Bytes owned across all blocks
+	size_t blocks;			//Heap blocks obtained (1 if never outgrown)
+};
+
+class Arena{
+public:
+	explicit Arena(size_t blockSize = 256*1024);
+	~Arena();
+
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	//Uninitialized storage for count objects of a trivially constructible type
+	template <typename T>
+	T *allocArray(size_t count){
+		return static_cast<T *>(allocate(count*sizeof(T), alignof(T)));
+	}
+
+	//Releases everything allocated since the last reset, keeping the blocks
+	void reset();
+
+	ArenaStats stats() const;
+
+private:
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+	struct Block{
+		char *data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t current;		//Block being bumped
+	size_t offset;		//Next free byte in the current block
+	size_t used;		//Bytes handed out since the last reset
+	size_t blockSize;
+	ArenaStats counters;
+};
+
+//Number of global operator new calls made by the calling thread, used to check
+//that a render loop does not touch the heap
+size_t threadHeapAllocations();
+
+#endif
@@ -0,0 +1,127 @@
+// ==========================================================================
+// Blue-noise dither masks for the area light samples
+// ==========================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "bluenoise.h"
+
+using namespace std;
+
+namespace {
+
+//Void-and-cluster (Ulichney 1993) on a size x size torus. energy[p] is the sum
+//of a Gaussian around every set texel; the tightest cluster is the set texel
+//with the most energy and the largest void the empty one with the least
+class Mask{
+public:
+	Mask(int size) : size(size), kernel(size*size), energy(size*size, 0.f), set(size*size, 0){
+		const float sigma = 1.5f;
+		for (int y = 0; y < size; y++){
+			for (int x = 0; x < size; x++){
+				int dx = std::min(x, size - x);
+				int dy = std::min(y, size - y);
+				kernel[y*size + x] = exp(-(dx*dx + dy*dy)/(2.f*sigma*sigma));
+			}
+		}
+	}
+
+	void toggle(int p){
+		set[p] = !set[p];
+		float sign = set[p] ? 1.f : -1.f;
+		int px = p % size, py = p / size;
+		for (int y = 0; y < size; y++){
+			const float *row = &kernel[((y - py + size) % size)*size];
+			float *out = &energy[y*size];
+			//row[(x - px) mod size], in the two runs where it does not wrap
+			for (int x = 0; x < px; x++)
+				out[x] += sign*row[x - px + size];
+			for (int x = px; x < size; x++)
+				out[x] += sign*row[x - px];
+		}
+	}
+
+	int tightestCluster() const{
+		int best = -1;
+		for (int p = 0; p < size*size; p++){
+			if (set[p] && (best < 0 || energy[p] > energy[best]))
+				best = p;
+		}
+		return best;
+	}
+
+	int largestVoid() const{
+		int best = -1;
+		for (int p = 0; p < size*size; p++){
+			if (!set[p] && (best < 0 || energy[p] < energy[best]))
+				best = p;
+		}
+		return best;
+	}
+
+	int size;
+	vector<float> kernel;
+	vector<float> energy;
+	vector<char> set;
+};
+
+vector<int> rankTexels(int size, mt19937 &generator){
+	int count = size*size;
+	Mask mask(size);
+
+	//Initial pattern: a tenth of the texels at random, then moved from the
+	//tightest cluster to the largest void until that stops changing anything
+	vector<int> texels(count);
+	for (int p = 0; p < count; p++)
+		texels[p] = p;
+	shuffle(texels.begin(), texels.end(), generator);
+	int ones = std::max(count/10, 1);
+	for (int i = 0; i < ones; i++)
+		mask.toggle(texels[i]);
+	while (true){
+		int cluster = mask.tightestCluster();
+		mask.toggle(cluster);
+		int hole = mask.largestVoid();
+		if (hole == cluster){
+			mask.toggle(cluster);
+			break;
+		}
+		mask.toggle(hole);
+	}
+
+	vector<int> rank(count);
+	vector<char> initial = mask.set;
+	vector<float> initialEnergy = mask.energy;
+
+	//Ranks below the initial pattern: take away tightest clusters
+	for (int r = ones - 1; r >= 0; r--){
+		int cluster = mask.tightestCluster();
+		mask.toggle(cluster);
+		rank[cluster] = r;
+	}
+
+	//Ranks above it: fill the largest voids. Past half of the texels the
+	//tightest cluster of the empty ones is the same texel, so one loop does
+	mask.set = initial;
+	mask.energy = initialEnergy;
+	for (int r = ones; r < count; r++){
+		int hole = mask.largestVoid();
+		mask.toggle(hole);
+		rank[hole] = r;
+	}
+	return rank;
+}
+
+}
+
+vector<unsigned char> blueNoise(int size, int channels, unsigned seed){
+	mt19937 generator(seed);
+	vector<unsigned char> texels(size*size*channels);
+	for (int c = 0; c < channels; c++){
+		vector<int> rank = rankTexels(size, generator);
+		for (int p = 0; p < size*size; p++)
+			texels[p*channels + c] = (unsigned char)(rank[p]*256/(size*size));
+	}
+	return texels;
+}
@@ -0,0 +1,18 @@
+// ==========================================================================
+// Blue-noise dither masks for the area light samples
+//
+// A mask ranks every texel of a size x size torus so that any threshold of it
+// is a set of points spread evenly with no clumps, which makes the error of a
+// sample pattern taken from it high frequency noise instead of blotches. The
+// tracer tiles the mask across the screen (see blueNoiseSample in trace.glsl).
+// ==========================================================================
+#ifndef BLUENOISE_H
+#define BLUENOISE_H
+
+#include <vector>
+
+//channels independent size x size masks generated with the void-and-cluster
+//method, interleaved per texel as 8 bit ranks 0..255 (RGBA8 for 4 channels)
+std::vector<unsigned char> blueNoise(int size, int channels, unsigned seed);
+
+#endif
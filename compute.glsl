@@ -0,0 +1,50 @@
+// ==========================================================================
+// Compute version of the tracer: one invocation per pixel of the pass, 8x8
+// pixel tiles per workgroup. Needs OpenGL 4.3
+// ==========================================================================
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// the pass target, the trace, low resolution or AA texture
+layout(rgba32f, binding = 0) uniform writeonly image2D target;
+
+#include "trace.glsl"
+
+// instrumentation, the same RGBA32UI textures the fragment program draws into
+#if ENABLE_COUNTERS
+layout(rgba32ui, binding = 1) uniform writeonly uimage2D counters0;
+layout(rgba32ui, binding = 2) uniform writeonly uimage2D counters1;
+#endif
+
+// primary hits for temporal reprojection, only bound while tracing the trace target
+#if ENABLE_REPROJECTION
+layout(rgba32f, binding = 3) uniform writeonly image2D hitTarget;
+#endif
+
+void writeCounters(ivec2 cell){
+#if ENABLE_COUNTERS
+	imageStore(counters0, cell, counts0);
+	imageStore(counters1, cell, counts1);
+#endif
+}
+
+void main(void){
+#if SHARED_PRIMITIVES
+	// every invocation helps fill shared memory before any of them may return
+	loadSharedPrimitives();
+#endif
+
+	// a pass covers the pixel at sampleOffset in every sampleStride block
+	ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 cells = (ivec2(resolution) + sampleStride - 1) / sampleStride;
+	if (any(greaterThanEqual(cell, cells))){
+		return;
+	}
+
+	imageStore(target, cell, shadePixel(cell * sampleStride + sampleOffset));
+	writeCounters(cell);
+#if ENABLE_REPROJECTION
+	imageStore(hitTarget, cell, primaryHit);
+#endif
+}
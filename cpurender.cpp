@@ -0,0 +1,285 @@
+// ==========================================================================
+// Multi-threaded CPU rendering with the tracer in tracer.cpp
+// ==========================================================================
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include "cpurender.h"
+
+using namespace std;
+
+namespace {
+
+// --------------------------------------------------------------------------
+// NUMA topology
+
+struct NumaNode{
+	int id;
+	vector<int> cpus;
+};
+
+//Parses a sysfs cpu list such as "0-3,8-11"
+vector<int> parseCpuList(const string &list){
+	vector<int> cpus;
+	stringstream ranges(list);
+	string range;
+	while (getline(ranges, range, ',')){
+		int first, last;
+		if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2){
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		else if (sscanf(range.c_str(), "%d", &first) == 1)
+			cpus.push_back(first);
+	}
+	return cpus;
+}
+
+//NUMA nodes with the CPUs this process may run on. Machines without NUMA
+//information come back as a single node.
+vector<NumaNode> numaTopology(){
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+
+	vector<NumaNode> nodes;
+	for (int id = 0; id < 1024; id++){
+		stringstream path;
+		path << "/sys/devices/system/node/node" << id << "/cpulist";
+		ifstream file(path.str().c_str());
+		if (!file){
+			if (id > 0 && nodes.empty())
+				break;
+			continue;
+		}
+		string list;
+		getline(file, list);
+
+		NumaNode node;
+		node.id = id;
+		vector<int> cpus = parseCpuList(list);
+		for (unsigned i = 0; i < cpus.size(); i++)
+			if (cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &allowed))
+				node.cpus.push_back(cpus[i]);
+		if (!node.cpus.empty())
+			nodes.push_back(node);
+	}
+
+	if (nodes.empty()){
+		NumaNode node;
+		node.id = 0;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed))
+				node.cpus.push_back(cpu);
+		nodes.push_back(node);
+	}
+	return nodes;
+}
+
+bool pinToCpu(int cpu){
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// --------------------------------------------------------------------------
+// Tile distribution
+
+struct NodeTiles{
+	atomic<int> next;
+	int end;
+	once_flag replicated;
+	Scene replica;
+};
+
+struct ThreadReport{
+	int node;
+	int cpu;			//-1 if not pinned
+	int tiles;
+	int stolen;			//Tiles taken from another node's band
+	double seconds;
+	size_t steadyHeap;	//operator new calls after the thread's first tile
+	ArenaStats arena;
+};
+
+struct RenderContext{
+	const Scene *scene;
+	const Camera *camera;
+	int width;
+	int height;
+	int tileSize;
+	int tilesX;
+	bool replicateScene;
+	vector<NodeTiles> *nodes;
+	unsigned char *rgb;
+};
+
+//Next tile for a thread on the given node, falling back to the other nodes
+int takeTile(vector<NodeTiles> &nodes, int home, bool &stolen){
+	for (unsigned i = 0; i < nodes.size(); i++){
+		NodeTiles &node = nodes[(home + i) % nodes.size()];
+		if (node.next.load(memory_order_relaxed) >= node.end)
+			continue;
+		int tile = node.next.fetch_add(1);
+		if (tile < node.end){
+			stolen = (i != 0);
+			return tile;
+		}
+	}
+	return -1;
+}
+
+void renderThread(RenderContext &context, ThreadReport &report){
+	auto start = chrono::steady_clock::now();
+	if (report.cpu >= 0 && !pinToCpu(report.cpu))
+		report.cpu = -1;
+
+	//The scene is copied by a thread running on the node, so first touch
+	//places the copy in that node's memory
+	NodeTiles &home = (*context.nodes)[report.node];
+	const Scene *scene = context.scene;
+	if (context.replicateScene){
+		call_once(home.replicated, [&]{ home.replica = *context.scene; });
+		scene = &home.replica;
+	}
+
+	Arena arena;
+	report.tiles = 0;
+	report.stolen = 0;
+	size_t heapAfterFirstTile = 0;
+
+	int tile;
+	bool stolen;
+	while ((tile = takeTile(*context.nodes, report.node, stolen)) >= 0){
+		int x = (tile % context.tilesX)*context.tileSize;
+		int y = (tile / context.tilesX)*context.tileSize;
+		int w = std::min(context.tileSize, context.width - x);
+		int h = std::min(context.tileSize, context.height - y);
+
+		arena.reset();
+		renderTile(*scene, *context.camera, context.width, context.height, x, y, w, h,
+				context.rgb + 3*(y*context.width + x), 3*context.width, arena);
+
+		if (report.tiles++ == 0)
+			heapAfterFirstTile = threadHeapAllocations();
+		if (stolen)
+			report.stolen++;
+	}
+
+	report.steadyHeap = (report.tiles > 0) ? threadHeapAllocations() - heapAfterFirstTile : 0;
+	report.arena = arena.stats();
+	report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}
+
+double renderCpu(const Scene &scene, const Camera &camera, int width, int height,
+		const CpuRenderOptions &options, vector<unsigned char> &rgb){
+	rgb.assign(width*height*3, 0);
+
+	int threadCount = std::max(1, options.threads);
+	vector<NumaNode> topology;
+	if (options.numa)
+		topology = numaTopology();
+	else
+		topology.push_back(NumaNode());
+	int nodeCount = topology.size();
+
+	RenderContext context;
+	context.scene = &scene;
+	context.camera = &camera;
+	context.width = width;
+	context.height = height;
+	context.tileSize = options.tileSize;
+	context.tilesX = (width + options.tileSize - 1)/options.tileSize;
+	context.replicateScene = options.numa && options.replicateScene;
+	context.rgb = &rgb[0];
+
+	//Each node gets a contiguous band of rows, in proportion to its threads
+	int tileCount = context.tilesX*((height + options.tileSize - 1)/options.tileSize);
+	vector<int> nodeThreads(nodeCount, 0);
+	for (int i = 0; i < threadCount; i++)
+		nodeThreads[i % nodeCount]++;
+	vector<NodeTiles> nodes(nodeCount);
+	int first = 0;
+	int assignedThreads = 0;
+	for (int n = 0; n < nodeCount; n++){
+		assignedThreads += nodeThreads[n];
+		nodes[n].next = first;
+		nodes[n].end = (int)((long long)tileCount*assignedThreads/threadCount);
+		first = nodes[n].end;
+	}
+	context.nodes = &nodes;
+
+	//Threads are spread round robin over the nodes, then over each node's CPUs
+	vector<ThreadReport> reports(threadCount);
+	for (int i = 0; i < threadCount; i++){
+		reports[i].node = i % nodeCount;
+		const vector<int> &cpus = topology[reports[i].node].cpus;
+		reports[i].cpu = options.numa ? cpus[(i / nodeCount) % cpus.size()] : -1;
+	}
+
+	vector<thread> threads;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < threadCount; i++)
+		threads.push_back(thread(renderThread, std::ref(context), std::ref(reports[i])));
+	for (int i = 0; i < threadCount; i++)
+		threads[i].join();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if (!options.report)
+		return seconds;
+
+	cout << "thread  node  cpu  tiles  stolen  seconds  arena peak  arena blocks  heap allocs after first tile" << endl;
+	size_t totalHeap = 0;
+	for (int i = 0; i < threadCount; i++){
+		const ThreadReport &report = reports[i];
+		cout << setw(6) << i << setw(6) << topology[report.node].id << setw(5) << report.cpu
+		     << setw(7) << report.tiles << setw(8) << report.stolen
+		     << setw(9) << fixed << setprecision(3) << report.seconds
+		     << setw(12) << report.arena.peakBytes << setw(14) << report.arena.blocks
+		     << setw(30) << report.steadyHeap << endl;
+		totalHeap += report.steadyHeap;
+	}
+	cout << tileCount << " tiles on " << threadCount << " thread(s) over " << nodeCount << " node(s) in "
+	     << seconds << " s, " << totalHeap << " heap allocations in the steady-state render loop" << endl;
+	return seconds;
+}
+
+void cpuScaling(const Scene &scene, const Camera &camera, int width, int height,
+		const CpuRenderOptions &options){
+	CpuRenderOptions run = options;
+	run.report = false;
+
+	vector<int> counts;
+	for (int threads = 1; threads < options.threads; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(std::max(1, options.threads));
+
+	vector<unsigned char> rgb;
+	cout << "threads  seconds  speedup  efficiency" << endl;
+	double baseline = 0.0;
+	for (unsigned i = 0; i < counts.size(); i++){
+		run.threads = counts[i];
+		//best of three to keep scheduling noise out of the numbers
+		double seconds = 1e30;
+		for (int repeat = 0; repeat < 3; repeat++)
+			seconds = std::min(seconds, renderCpu(scene, camera, width, height, run, rgb));
+		if (i == 0)
+			baseline = seconds;
+		cout << setw(7) << counts[i] << setw(9) << fixed << setprecision(3) << seconds
+		     << setw(9) << setprecision(2) << baseline/seconds
+		     << setw(12) << setprecision(2) << baseline/seconds/counts[i] << endl;
+	}
+}
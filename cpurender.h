@@ -0,0 +1,33 @@
+// ==========================================================================
+// Multi-threaded CPU rendering with the tracer in tracer.cpp
+//
+// With NUMA placement on, threads are spread over the NUMA nodes listed in
+// /sys/devices/system/node and pinned to CPUs of their node. Each node owns a
+// contiguous band of tiles and its threads only steal from other nodes once
+// their band is finished. With replication on, the first thread of every node
+// copies the scene, so its pages are allocated on that node by first touch.
+// ==========================================================================
+#ifndef CPURENDER_H
+#define CPURENDER_H
+
+#include <vector>
+#include "tracer.h"
+
+struct CpuRenderOptions{
+	int threads;
+	int tileSize;
+	bool numa;				//Pin threads and hand out tiles node-locally
+	bool replicateScene;	//One scene copy per NUMA node (needs numa)
+	bool report;			//Print the per-thread report
+};
+
+//Renders the image into rgb (width*height*3, top row first), returns seconds taken
+double renderCpu(const Scene &scene, const Camera &camera, int width, int height,
+		const CpuRenderOptions &options, std::vector<unsigned char> &rgb);
+
+//Renders the image with 1, 2, 4, ... up to options.threads threads and prints
+//the time and speedup of each
+void cpuScaling(const Scene &scene, const Camera &camera, int width, int height,
+		const CpuRenderOptions &options);
+
+#endif
@@ -0,0 +1,423 @@
+// ==========================================================================
+// Distributed rendering over TCP or Unix domain sockets
+//
+// Protocol (all integers are 32 bit, network byte order; floats are sent as
+// their bit patterns):
+//   coordinator -> worker  JOB   magic, width, height, scene3, camera (5
+//                                floats), scene text length, scene text
+//   worker -> coordinator  READY magic
+//   coordinator -> worker  TILE  x, y, w, h   (w == 0 ends the job)
+//   worker -> coordinator  TILE  x, y, w, h, w*h*3 bytes of RGB
+//
+// The worker drops the connection on a job larger than MAX_IMAGE_SIZE or
+// MAX_SCENE_TEXT, or a tile that is not inside the image.
+// ==========================================================================
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "distributed.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const uint32_t JOB_MAGIC = 0x52544a31;		//"RTJ1"
+const uint32_t READY_MAGIC = 0x52545231;	//"RTR1"
+
+const uint32_t MAX_IMAGE_SIZE = 16384;		//Pixels, either dimension
+const uint32_t MAX_SCENE_TEXT = 64 << 20;	//Bytes
+
+struct Tile{
+	int x, y, w, h;
+};
+
+// --------------------------------------------------------------------------
+// Socket helpers
+
+bool sendAll(int fd, const void *data, size_t length){
+	const char *bytes = (const char *)data;
+	while (length > 0){
+		ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+bool recvAll(int fd, void *data, size_t length){
+	char *bytes = (char *)data;
+	while (length > 0){
+		ssize_t received = recv(fd, bytes, length, 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		length -= received;
+	}
+	return true;
+}
+
+bool sendInts(int fd, const uint32_t *values, int count){
+	uint32_t packed[16];
+	for (int i = 0; i < count; i++)
+		packed[i] = htonl(values[i]);
+	return sendAll(fd, packed, count*sizeof(uint32_t));
+}
+
+bool recvInts(int fd, uint32_t *values, int count){
+	if (!recvAll(fd, values, count*sizeof(uint32_t)))
+		return false;
+	for (int i = 0; i < count; i++)
+		values[i] = ntohl(values[i]);
+	return true;
+}
+
+uint32_t floatBits(float value){
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+float bitsFloat(uint32_t bits){
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+bool isUnixAddress(const string &address){
+	return address.compare(0, 5, "unix:") == 0;
+}
+
+//Splits "host:port" (or a bare port) into its parts
+void splitAddress(const string &address, string &host, string &port){
+	size_t colon = address.rfind(':');
+	if (colon == string::npos){
+		host = "";
+		port = address;
+	}
+	else {
+		host = address.substr(0, colon);
+		port = address.substr(colon + 1);
+	}
+}
+
+int connectTo(const string &address){
+	if (isUnixAddress(address)){
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+			return fd;
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	string host, port;
+	splitAddress(address, host, port);
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo *results;
+	if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &results) != 0)
+		return -1;
+
+	int fd = -1;
+	for (addrinfo *info = results; info != NULL; info = info->ai_next){
+		fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, info->ai_addr, info->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(results);
+
+	if (fd >= 0){
+		int noDelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	}
+	return fd;
+}
+
+int listenOn(const string &address){
+	if (isUnixAddress(address)){
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+		unlink(addr.sun_path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0){
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	string host, port;
+	splitAddress(address, host, port);
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	addrinfo *results;
+	if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &results) != 0)
+		return -1;
+
+	int fd = socket(results->ai_family, results->ai_socktype, results->ai_protocol);
+	int reuse = 1;
+	if (fd >= 0)
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if (fd < 0 || bind(fd, results->ai_addr, results->ai_addrlen) != 0 || listen(fd, 8) != 0){
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(results);
+	return fd;
+}
+
+// --------------------------------------------------------------------------
+// Worker side
+
+//Receives one job and traces tiles for it until the coordinator ends it
+void serveJob(int fd){
+	uint32_t header[10];
+	if (!recvInts(fd, header, 10) || header[0] != JOB_MAGIC){
+		cout << "worker: bad job header" << endl;
+		return;
+	}
+
+	//Checked before the casts, a size above INT_MAX would come out negative
+	if (header[1] == 0 || header[1] > MAX_IMAGE_SIZE || header[2] == 0 || header[2] > MAX_IMAGE_SIZE
+			|| header[9] > MAX_SCENE_TEXT){
+		cout << "worker: rejected a " << header[1] << "x" << header[2] << " job with "
+		     << header[9] << " bytes of scene text" << endl;
+		return;
+	}
+	int width = header[1];
+	int height = header[2];
+	Camera camera;
+	camera.pos = vec3(bitsFloat(header[4]), bitsFloat(header[5]), bitsFloat(header[6]));
+	camera.xRot = bitsFloat(header[7]);
+	camera.yRot = bitsFloat(header[8]);
+	uint32_t sceneLength = header[9];
+
+	string sceneText(sceneLength, '\0');
+	if (sceneLength > 0 && !recvAll(fd, &sceneText[0], sceneLength))
+		return;
+
+	triangleVecs.clear();
+	sphereVecs.clear();
+	planeVecs.clear();
+	lightVecs.clear();
+	parseObjects(sceneText);
+	Scene scene = buildScene(header[3] != 0);
+
+	if (!sendInts(fd, &READY_MAGIC, 1))
+		return;
+
+	Arena arena;
+	int tiles = 0;
+	size_t heapAfterFirstTile = 0;
+	while (true){
+		uint32_t request[4];
+		if (!recvInts(fd, request, 4) || request[2] == 0)
+			break;
+
+		//Unsigned, so a negative value on the coordinator side fails here too
+		if (request[0] >= (uint32_t)width || request[1] >= (uint32_t)height
+				|| request[2] > (uint32_t)width - request[0] || request[3] == 0 || request[3] > (uint32_t)height - request[1]){
+			cout << "worker: tile " << request[0] << "," << request[1] << " " << request[2] << "x" << request[3]
+			     << " is outside the " << width << "x" << height << " image" << endl;
+			break;
+		}
+		Tile tile = {(int)request[0], (int)request[1], (int)request[2], (int)request[3]};
+		arena.reset();
+		unsigned char *rgb = arena.allocArray<unsigned char>(tile.w*tile.h*3);
+		renderTile(scene, camera, width, height, tile.x, tile.y, tile.w, tile.h, rgb, tile.w*3, arena);
+
+		if (!sendInts(fd, request, 4) || !sendAll(fd, rgb, tile.w*tile.h*3))
+			break;
+		if (tiles++ == 0)
+			heapAfterFirstTile = threadHeapAllocations();
+	}
+	size_t steadyHeap = threadHeapAllocations() - heapAfterFirstTile;
+
+	ArenaStats stats = arena.stats();
+	cout << "worker: traced " << tiles << " tiles of a " << width << "x" << height << " image, arena peak "
+	     << stats.peakBytes << " bytes in " << stats.blocks << " block(s), "
+	     << (tiles > 0 ? steadyHeap : 0) << " heap allocations after the first tile" << endl;
+}
+
+// --------------------------------------------------------------------------
+// Coordinator side
+
+struct TileQueue{
+	mutex lock;
+	condition_variable changed;
+	deque<Tile> pending;
+	int completed;
+	int total;
+};
+
+//Sends the job to one worker, returns the connected socket or -1
+int startJob(const string &address, const RenderJob &job){
+	int fd = connectTo(address);
+	if (fd < 0){
+		cout << "coordinator: could not connect to " << address << endl;
+		return -1;
+	}
+
+	uint32_t header[10] = {
+		JOB_MAGIC, (uint32_t)job.width, (uint32_t)job.height, job.scene3 ? 1u : 0u,
+		floatBits(job.camera.pos.x), floatBits(job.camera.pos.y), floatBits(job.camera.pos.z),
+		floatBits(job.camera.xRot), floatBits(job.camera.yRot),
+		(uint32_t)job.sceneText.size()
+	};
+	uint32_t ready = 0;
+	if (!sendInts(fd, header, 10) || !sendAll(fd, job.sceneText.data(), job.sceneText.size())
+			|| !recvInts(fd, &ready, 1) || ready != READY_MAGIC){
+		cout << "coordinator: worker " << address << " rejected the job" << endl;
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//Hands tiles to one worker until none are left. A tile lost to a failed worker
+//goes back on the queue for the others.
+void driveWorker(int fd, const string &address, const RenderJob &job, TileQueue &queue,
+		vector<unsigned char> &rgb, int &tilesDone){
+	vector<unsigned char> tileRGB;
+	while (true){
+		Tile tile;
+		{
+			unique_lock<mutex> guard(queue.lock);
+			queue.changed.wait(guard, [&]{ return !queue.pending.empty() || queue.completed == queue.total; });
+			if (queue.pending.empty())
+				break;
+			tile = queue.pending.front();
+			queue.pending.pop_front();
+		}
+
+		uint32_t request[4] = {(uint32_t)tile.x, (uint32_t)tile.y, (uint32_t)tile.w, (uint32_t)tile.h};
+		uint32_t reply[4];
+		tileRGB.resize(tile.w*tile.h*3);
+		bool ok = sendInts(fd, request, 4) && recvInts(fd, reply, 4)
+				&& memcmp(request, reply, sizeof(request)) == 0
+				&& recvAll(fd, &tileRGB[0], tileRGB.size());
+
+		unique_lock<mutex> guard(queue.lock);
+		if (!ok){
+			cout << "coordinator: lost worker " << address << ", requeueing its tile" << endl;
+			queue.pending.push_back(tile);
+			queue.changed.notify_all();
+			close(fd);
+			return;
+		}
+		for (int row = 0; row < tile.h; row++)
+			memcpy(&rgb[3*((tile.y + row)*job.width + tile.x)], &tileRGB[3*row*tile.w], 3*tile.w);
+		queue.completed++;
+		tilesDone++;
+		queue.changed.notify_all();
+	}
+
+	uint32_t done[4] = {0, 0, 0, 0};
+	sendInts(fd, done, 4);
+	close(fd);
+}
+
+}
+
+int runWorker(const string &address){
+	int listenFd = listenOn(address);
+	if (listenFd < 0){
+		cout << "worker: could not listen on " << address << endl;
+		return -1;
+	}
+	cout << "worker: listening on " << address << endl;
+
+	while (true){
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		serveJob(fd);
+		close(fd);
+	}
+	return 0;
+}
+
+bool runCoordinator(const string &hostsFile, const RenderJob &job, vector<unsigned char> &rgb){
+	vector<string> addresses;
+	ifstream hosts(hostsFile.c_str());
+	string line;
+	while (getline(hosts, line)){
+		line = line.substr(0, line.find('#'));
+		istringstream words(line);
+		string address;
+		if (words >> address)
+			addresses.push_back(address);
+	}
+	if (addresses.empty()){
+		cout << "coordinator: no workers listed in " << hostsFile << endl;
+		return false;
+	}
+
+	TileQueue queue;
+	for (int y = 0; y < job.height; y += job.tileSize)
+		for (int x = 0; x < job.width; x += job.tileSize){
+			Tile tile = {x, y, std::min(job.tileSize, job.width - x), std::min(job.tileSize, job.height - y)};
+			queue.pending.push_back(tile);
+		}
+	queue.completed = 0;
+	queue.total = queue.pending.size();
+	rgb.assign(job.width*job.height*3, 0);
+
+	auto start = chrono::steady_clock::now();
+
+	vector<thread> threads;
+	vector<int> tilesDone(addresses.size(), 0);
+	for (unsigned i = 0; i < addresses.size(); i++){
+		int fd = startJob(addresses[i], job);
+		if (fd >= 0)
+			threads.push_back(thread(driveWorker, fd, addresses[i], std::cref(job), std::ref(queue), std::ref(rgb), std::ref(tilesDone[i])));
+	}
+	for (unsigned i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	for (unsigned i = 0; i < addresses.size(); i++)
+		cout << "coordinator: " << addresses[i] << " traced " << tilesDone[i] << " tiles" << endl;
+	cout << "coordinator: " << queue.completed << "/" << queue.total << " tiles in " << seconds << " s" << endl;
+
+	return queue.completed == queue.total;
+}
@@ -0,0 +1,33 @@
+// ==========================================================================
+// Distributed rendering over TCP or Unix domain sockets
+//
+// A coordinator ships the scene file text and camera to every worker listed
+// in a host file, hands out tiles on demand and assembles the image. Workers
+// trace tiles with the CPU tracer. Addresses are "host:port", a bare port
+// (workers listen on all interfaces) or "unix:/path/to/socket".
+// ==========================================================================
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <string>
+#include <vector>
+#include "tracer.h"
+
+struct RenderJob{
+	std::string sceneText;		//Contents of the scene file
+	bool scene3;
+	Camera camera;
+	int width;
+	int height;
+	int tileSize;
+};
+
+//Serves render jobs on the given address until killed, returns non-zero on setup failure
+int runWorker(const std::string &address);
+
+//Renders the job on the workers listed in hostsFile (one address per line, '#'
+//starts a comment) and writes the image to rgb (width*height*3, top row first).
+//Returns false if the image could not be completed.
+bool runCoordinator(const std::string &hostsFile, const RenderJob &job, std::vector<unsigned char> &rgb);
+
+#endif
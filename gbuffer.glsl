@@ -0,0 +1,72 @@
+// ==========================================================================
+// Fragment program of the G-buffer pass (hybrid rendering): writes the hit
+// point and id of the triangle or sphere seen through each pixel centre, the
+// tracer then only follows that hit's shadow and reflection rays
+// ==========================================================================
+#version 410
+
+in vec3 worldPos;
+flat in vec4 sphere;		// centre and radius
+flat in float primitive;	// objType * 1024 + index + 1, as in trace.glsl
+
+layout(location = 0) out vec4 GBuffer;
+
+uniform float xPos;
+uniform float yPos;
+uniform float zPos;
+uniform float xRot;
+uniform float yRot;
+uniform vec2 resolution = vec2(512.0);
+uniform bool sphereQuads = false;
+
+const float PI = 3.1415926535897932384626433832795;
+const float FOV = PI/3.0;
+const float NEAR = 0.001;
+const float FAR = 100000.0;		// the tracer's miss distance
+
+mat3 rotationMatrixY(float theta){
+	return mat3(cos(theta), 0.0, 	sin(theta),
+				0.0,		1.0, 	0.0,
+				-sin(theta), 0.0,	cos(theta));
+}
+
+mat3 rotationMatrixX(float theta){
+	return mat3(1.0,	0.0, 		0.0,
+				0.0,	cos(theta), -sin(theta),
+				0.0,	sin(theta),	cos(theta));
+}
+
+void main(void){
+	// depth is the distance along the ray, the tracer's own order, which
+	// keeps its precision far from the camera
+	vec3 origin = vec3(xPos, yPos, zPos);
+	if (!sphereQuads){
+		GBuffer = vec4(worldPos, primitive);
+		gl_FragDepth = distance(worldPos, origin) / FAR;
+		return;
+	}
+
+	// the primary ray of this pixel (tracePixel) against the sphere, nearest
+	// hit in front of the camera as intersectSphere picks it
+	vec2 pixelPos = gl_FragCoord.xy / resolution * 2.0 - 1.0;
+	pixelPos.x *= resolution.x / resolution.y;
+	mat3 rotation = rotationMatrixX(xRot) * rotationMatrixY(yRot);
+	vec3 dir = normalize(vec3(pixelPos, -1.0 / tan(FOV * 0.5))) * rotation;
+
+	vec3 offset = origin - sphere.xyz;
+	float b = dot(offset, dir);
+	float discriminant = b * b - dot(offset, offset) + sphere.w * sphere.w;
+	if (discriminant < 0.0){
+		discard;
+	}
+	float t = -b - sqrt(discriminant);
+	if (t < 0.0){
+		t = -b + sqrt(discriminant);
+	}
+	if (t < NEAR){
+		discard;
+	}
+
+	GBuffer = vec4(origin + t * dir, primitive);
+	gl_FragDepth = t / FAR;
+}
@@ -0,0 +1,76 @@
+// ==========================================================================
+// Vertex program of the G-buffer pass (hybrid rendering): projects the
+// scene's triangles and a quad around each sphere with the tracer's camera
+// ==========================================================================
+#version 410
+
+// triangles: corner and 0, spheres: centre and radius
+layout(location = 0) in vec4 VertexPosition;
+// spheres: corner of the quad in [-1,1], then the primitive id of both
+layout(location = 1) in vec3 VertexCorner;
+
+uniform float xPos;
+uniform float yPos;
+uniform float zPos;
+uniform float xRot;
+uniform float yRot;
+uniform vec2 resolution = vec2(512.0);
+uniform bool sphereQuads = false;
+
+out vec3 worldPos;
+flat out vec4 sphere;
+flat out float primitive;
+
+const float PI = 3.1415926535897932384626433832795;
+const float FOV = PI/3.0;
+const float NEAR = 0.001;		// clipping only, gbuffer.glsl writes the depth
+const float FAR = 100000.0;
+
+mat3 rotationMatrixY(float theta){
+	return mat3(cos(theta), 0.0, 	sin(theta),
+				0.0,		1.0, 	0.0,
+				-sin(theta), 0.0,	cos(theta));
+}
+
+mat3 rotationMatrixX(float theta){
+	return mat3(1.0,	0.0, 		0.0,
+				0.0,	cos(theta), -sin(theta),
+				0.0,	sin(theta),	cos(theta));
+}
+
+// perspective projection matching the primary rays of tracePixel()
+vec4 project(vec3 view){
+	float f = 1.0 / tan(FOV * 0.5);
+	return vec4(view.x * f * resolution.y / resolution.x, view.y * f,
+	            (view.z * (FAR + NEAR) + 2.0 * FAR * NEAR) / (NEAR - FAR), -view.z);
+}
+
+void main()
+{
+	// world to camera, the inverse of the primary ray rotation
+	mat3 rotation = rotationMatrixX(xRot) * rotationMatrixY(yRot);
+	vec3 camera = vec3(xPos, yPos, zPos);
+	primitive = VertexCorner.z;
+	sphere = VertexPosition;
+	worldPos = VertexPosition.xyz;
+	if (!sphereQuads){
+		gl_Position = project(rotation * (VertexPosition.xyz - camera));
+		return;
+	}
+
+	// a square facing the camera, just large enough to hold the cone of rays
+	// that touch the sphere
+	vec3 centre = rotation * (VertexPosition.xyz - camera);
+	float radius = VertexPosition.w;
+	float d = length(centre);
+	vec3 axis = centre / d;
+	vec3 right = normalize(cross(axis, (abs(axis.y) < 0.9) ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+	vec3 up = cross(right, axis);
+	float size = radius * d / sqrt(max(d * d - radius * radius, 1e-12));
+	if (d <= radius || centre.z + size * (abs(right.z) + abs(up.z)) > -NEAR){
+		// the sphere reaches the near plane, cover the whole view instead
+		gl_Position = vec4(VertexCorner.xy, 0.0, 1.0);
+		return;
+	}
+	gl_Position = project(centre + size * (VertexCorner.x * right + VertexCorner.y * up));
+}
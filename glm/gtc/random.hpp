@@ -91,6 +91,154 @@ namespace glm
 	template <typename T>
 	GLM_FUNC_DECL tvec3<T, defaultp> ballRand(
 		T Radius);
+
+	/// PCG32 generator (O'Neill 2014): a 64 bit LCG whose output goes through a
+	/// random xorshift and rotation. Generators with different streams never
+	/// share a sequence. Owned by the caller, one per thread.
+	/// @see gtc_random
+	class pcg32
+	{
+	public:
+		typedef uint32 result_type;
+
+		GLM_FUNC_DECL explicit pcg32(uint64 Seed = 0x853c49e6748fea9bull, uint64 Stream = 0xda3e39cb94b95bdbull);
+
+		/// Next 32 random bits
+		GLM_FUNC_DECL uint32 operator()();
+
+	private:
+		uint64 State;
+		uint64 Increment;
+	};
+
+	/// xoshiro128+ generator (Blackman and Vigna 2018), 128 bits of state. Its
+	/// low bits are weak, the functions here only use the top 24 to 27 bits.
+	/// Owned by the caller, one per thread.
+	/// @see gtc_random
+	class xoshiro128p
+	{
+	public:
+		typedef uint32 result_type;
+
+		/// The state is filled from Seed by splitmix64
+		GLM_FUNC_DECL explicit xoshiro128p(uint64 Seed = 1);
+
+		/// Next 32 random bits
+		GLM_FUNC_DECL uint32 operator()();
+
+		/// Skips 2^64 values, for non-overlapping sequences from one seed
+		GLM_FUNC_DECL void jump();
+
+	private:
+		friend class xoshiro128p_x4;
+		uint32 s[4];
+	};
+
+	/// Four xoshiro128+ generators a 2^64 jump apart, advanced together in the
+	/// lanes of an SSE2 register (one after the other without SSE2). Used by
+	/// the batched functions below.
+	/// @see gtc_random
+	class xoshiro128p_x4
+	{
+	public:
+		GLM_FUNC_DECL explicit xoshiro128p_x4(uint64 Seed = 1);
+
+		/// Next 32 random bits of each lane
+		GLM_FUNC_DECL void next(uint32 Out[4]);
+
+#		if GLM_ARCH & GLM_ARCH_SSE2_BIT
+			GLM_FUNC_DECL __m128i next();
+#		endif
+
+	private:
+		uint32 s[4][4];		// s[word][lane]
+	};
+
+	/// Generate random numbers in the interval [Min, Max) for floating point
+	/// types and [Min, Max] for integers, drawing from a caller-owned
+	/// generator instead of std::rand(), so threads can draw concurrently.
+	/// 
+	/// @param Min 
+	/// @param Max 
+	/// @param Generator Any functor returning 32 random bits: pcg32, xoshiro128p or std::mt19937
+	/// @tparam genType Value type. Currently supported: float, double and integer scalars.
+	/// @see gtc_random
+	template <typename genType, typename genRNG>
+	GLM_FUNC_DECL genType linearRand(
+		genType Min,
+		genType Max,
+		genRNG & Generator);
+
+	/// Per component linearRand(Min, Max, Generator)
+	/// @see gtc_random
+	template <typename T, precision P, template <typename, precision> class vecType, typename genRNG>
+	GLM_FUNC_DECL vecType<T, P> linearRand(
+		vecType<T, P> const & Min,
+		vecType<T, P> const & Max,
+		genRNG & Generator);
+
+	/// Gaussian distribution drawn from Generator. Unlike gaussRand(Mean,
+	/// Deviation), Deviation is the standard deviation.
+	/// @see gtc_random
+	template <typename genType, typename genRNG>
+	GLM_FUNC_DECL genType gaussRand(
+		genType Mean,
+		genType Deviation,
+		genRNG & Generator);
+
+	/// circularRand(Radius) drawn from Generator
+	/// @see gtc_random
+	template <typename T, typename genRNG>
+	GLM_FUNC_DECL tvec2<T, defaultp> circularRand(
+		T Radius,
+		genRNG & Generator);
+
+	/// sphericalRand(Radius) drawn from Generator
+	/// @see gtc_random
+	template <typename T, typename genRNG>
+	GLM_FUNC_DECL tvec3<T, defaultp> sphericalRand(
+		T Radius,
+		genRNG & Generator);
+
+	/// diskRand(Radius) drawn from Generator
+	/// @see gtc_random
+	template <typename T, typename genRNG>
+	GLM_FUNC_DECL tvec2<T, defaultp> diskRand(
+		T Radius,
+		genRNG & Generator);
+
+	/// ballRand(Radius) drawn from Generator
+	/// @see gtc_random
+	template <typename T, typename genRNG>
+	GLM_FUNC_DECL tvec3<T, defaultp> ballRand(
+		T Radius,
+		genRNG & Generator);
+
+	/// Fills Result with Count random floats in [Min, Max), four at a time
+	/// @see gtc_random
+	GLM_FUNC_DECL void linearRand(
+		float * Result,
+		std::size_t Count,
+		float Min,
+		float Max,
+		xoshiro128p_x4 & Generator);
+
+	/// Fills Result with Count points on the circle of the given radius, four at a time
+	/// @see gtc_random
+	GLM_FUNC_DECL void circularRand(
+		tvec2<float, defaultp> * Result,
+		std::size_t Count,
+		float Radius,
+		xoshiro128p_x4 & Generator);
+
+	/// Fills Result with Count points on the sphere of the given radius (uniform
+	/// directions for radius 1), four at a time
+	/// @see gtc_random
+	GLM_FUNC_DECL void sphericalRand(
+		tvec3<float, defaultp> * Result,
+		std::size_t Count,
+		float Radius,
+		xoshiro128p_x4 & Generator);
 	
 	/// @}
 }//namespace glm
@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <cassert>
+#include <limits>
 
 namespace glm{
 namespace detail
@@ -22,7 +23,7 @@ namespace detail
 		GLM_FUNC_QUALIFIER static tvec1<uint8, P> call()
 		{
 			return tvec1<uint8, P>(
-				std::rand() % std::numeric_limits<uint8>::max());
+				std::rand() % (std::numeric_limits<uint8>::max() + 1));
 		}
 	};
 
@@ -32,8 +33,8 @@ namespace detail
 		GLM_FUNC_QUALIFIER static tvec2<uint8, P> call()
 		{
 			return tvec2<uint8, P>(
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max());
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1));
 		}
 	};
 
@@ -43,9 +44,9 @@ namespace detail
 		GLM_FUNC_QUALIFIER static tvec3<uint8, P> call()
 		{
 			return tvec3<uint8, P>(
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max());
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1));
 		}
 	};
 
@@ -55,10 +56,10 @@ namespace detail
 		GLM_FUNC_QUALIFIER static tvec4<uint8, P> call()
 		{
 			return tvec4<uint8, P>(
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max(),
-				std::rand() % std::numeric_limits<uint8>::max());
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1),
+				std::rand() % (std::numeric_limits<uint8>::max() + 1));
 		}
 	};
 
@@ -347,4 +348,412 @@ namespace detail
 	
 		return tvec3<T, defaultp>(x, y, z) * Radius;	
 	}
+
+	// Caller-owned generators
+
+	GLM_FUNC_QUALIFIER pcg32::pcg32(uint64 Seed, uint64 Stream) :
+		State(0u),
+		Increment((Stream << 1u) | 1u)
+	{
+		(*this)();
+		State += Seed;
+		(*this)();
+	}
+
+	GLM_FUNC_QUALIFIER uint32 pcg32::operator()()
+	{
+		uint64 const Old = State;
+		State = Old * 6364136223846793005ull + Increment;
+		uint32 const Xorshifted = static_cast<uint32>(((Old >> 18u) ^ Old) >> 27u);
+		uint32 const Rotation = static_cast<uint32>(Old >> 59u);
+		return (Xorshifted >> Rotation) | (Xorshifted << ((32u - Rotation) & 31u));
+	}
+
+namespace detail
+{
+	GLM_FUNC_QUALIFIER uint64 splitmix64(uint64 & x)
+	{
+		uint64 z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30u)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27u)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31u);
+	}
+
+	GLM_FUNC_QUALIFIER uint32 rotl(uint32 x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+}//namespace detail
+
+	GLM_FUNC_QUALIFIER xoshiro128p::xoshiro128p(uint64 Seed)
+	{
+		uint64 const a = detail::splitmix64(Seed);
+		uint64 const b = detail::splitmix64(Seed);
+		s[0] = static_cast<uint32>(a);
+		s[1] = static_cast<uint32>(a >> 32u);
+		s[2] = static_cast<uint32>(b);
+		s[3] = static_cast<uint32>(b >> 32u);
+	}
+
+	GLM_FUNC_QUALIFIER uint32 xoshiro128p::operator()()
+	{
+		uint32 const Result = s[0] + s[3];
+		uint32 const t = s[1] << 9u;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = detail::rotl(s[3], 11);
+		return Result;
+	}
+
+	GLM_FUNC_QUALIFIER void xoshiro128p::jump()
+	{
+		static uint32 const Jump[4] = {0x8764000bu, 0xf542d2d3u, 0x6fa035c3u, 0x77f2db5bu};
+		uint32 t[4] = {0u, 0u, 0u, 0u};
+		for(int i = 0; i < 4; ++i)
+		for(int b = 0; b < 32; ++b)
+		{
+			if(Jump[i] & (1u << b))
+			{
+				t[0] ^= s[0];
+				t[1] ^= s[1];
+				t[2] ^= s[2];
+				t[3] ^= s[3];
+			}
+			(*this)();
+		}
+		s[0] = t[0];
+		s[1] = t[1];
+		s[2] = t[2];
+		s[3] = t[3];
+	}
+
+	GLM_FUNC_QUALIFIER xoshiro128p_x4::xoshiro128p_x4(uint64 Seed)
+	{
+		xoshiro128p Lane(Seed);
+		for(int l = 0; l < 4; ++l)
+		{
+			for(int w = 0; w < 4; ++w)
+				s[w][l] = Lane.s[w];
+			Lane.jump();
+		}
+	}
+
+#	if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	GLM_FUNC_QUALIFIER __m128i xoshiro128p_x4::next()
+	{
+		__m128i s0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s[0]));
+		__m128i s1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s[1]));
+		__m128i s2 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s[2]));
+		__m128i s3 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s[3]));
+		__m128i const Result = _mm_add_epi32(s0, s3);
+		__m128i const t = _mm_slli_epi32(s1, 9);
+		s2 = _mm_xor_si128(s2, s0);
+		s3 = _mm_xor_si128(s3, s1);
+		s1 = _mm_xor_si128(s1, s2);
+		s0 = _mm_xor_si128(s0, s3);
+		s2 = _mm_xor_si128(s2, t);
+		s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(s[0]), s0);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(s[1]), s1);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(s[2]), s2);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(s[3]), s3);
+		return Result;
+	}
+
+	GLM_FUNC_QUALIFIER void xoshiro128p_x4::next(uint32 Out[4])
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(Out), next());
+	}
+#	else
+	GLM_FUNC_QUALIFIER void xoshiro128p_x4::next(uint32 Out[4])
+	{
+		for(int l = 0; l < 4; ++l)
+		{
+			Out[l] = s[0][l] + s[3][l];
+			uint32 const t = s[1][l] << 9u;
+			s[2][l] ^= s[0][l];
+			s[3][l] ^= s[1][l];
+			s[1][l] ^= s[2][l];
+			s[0][l] ^= s[3][l];
+			s[2][l] ^= t;
+			s[3][l] = detail::rotl(s[3][l], 11);
+		}
+	}
+#	endif
+
+namespace detail
+{
+	// [0, 1) from the top bits of 32 bit draws
+	template <typename T>
+	struct compute_unitRand
+	{
+		template <typename genRNG>
+		GLM_FUNC_QUALIFIER static T call(genRNG & Generator)
+		{
+			uint32 const High = static_cast<uint32>(Generator()) >> 5u;
+			uint32 const Low = static_cast<uint32>(Generator()) >> 6u;
+			return (static_cast<T>(High) * static_cast<T>(67108864) + static_cast<T>(Low)) / static_cast<T>(9007199254740992.0);
+		}
+	};
+
+	template <>
+	struct compute_unitRand<float>
+	{
+		template <typename genRNG>
+		GLM_FUNC_QUALIFIER static float call(genRNG & Generator)
+		{
+			return static_cast<float>(static_cast<uint32>(Generator()) >> 8u) * (1.0f / 16777216.0f);
+		}
+	};
+
+	template <typename T, bool isFloat = std::numeric_limits<T>::is_iec559>
+	struct compute_linearRandGen
+	{
+		// integers, Min and Max included
+		template <typename genRNG>
+		GLM_FUNC_QUALIFIER static T call(T Min, T Max, genRNG & Generator)
+		{
+			uint64 const Range = static_cast<uint64>(Max) - static_cast<uint64>(Min) + 1u;
+			uint64 Offset;
+			if(Range != 0u && Range <= (static_cast<uint64>(1) << 32u))
+				Offset = (static_cast<uint64>(static_cast<uint32>(Generator())) * Range) >> 32u;
+			else
+			{
+				uint64 const Bits = (static_cast<uint64>(static_cast<uint32>(Generator())) << 32u) | static_cast<uint32>(Generator());
+				Offset = Range == 0u ? Bits : Bits % Range;
+			}
+			return static_cast<T>(static_cast<uint64>(Min) + Offset);
+		}
+	};
+
+	template <typename T>
+	struct compute_linearRandGen<T, true>
+	{
+		template <typename genRNG>
+		GLM_FUNC_QUALIFIER static T call(T Min, T Max, genRNG & Generator)
+		{
+			return compute_unitRand<T>::call(Generator) * (Max - Min) + Min;
+		}
+	};
+
+#	if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	// Four floats in [0, 1) from the top 24 bits of each lane
+	GLM_FUNC_QUALIFIER __m128 unitRand4(xoshiro128p_x4 & Generator)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(Generator.next(), 8)), _mm_set1_ps(1.0f / 16777216.0f));
+	}
+
+	// Cosine and sine of 2 pi u for u in [0, 1): u is moved to [-1/4, 1/4] with
+	// the same sine (and the cosine negated where needed), where the Taylor
+	// series to the 11th and 12th power are accurate to float precision
+	GLM_FUNC_QUALIFIER void cosSin2Pi(__m128 u, __m128 & Cos, __m128 & Sin)
+	{
+		__m128 const Half = _mm_set1_ps(0.5f);
+		__m128 const SignBit = _mm_set1_ps(-0.0f);
+		// y in [-1/2, 1/2) with sin(2 pi y) = sin(2 pi u)
+		__m128 y = _mm_sub_ps(u, _mm_and_ps(_mm_cmpge_ps(u, Half), _mm_set1_ps(1.0f)));
+		// past a quarter turn, reflect around it: sin(pi - x) = sin(x), cos(pi - x) = -cos(x)
+		__m128 const YSign = _mm_and_ps(y, SignBit);
+		__m128 const Far = _mm_cmpgt_ps(_mm_andnot_ps(SignBit, y), _mm_set1_ps(0.25f));
+		__m128 const Reflected = _mm_sub_ps(_mm_or_ps(Half, YSign), y);
+		y = _mm_or_ps(_mm_and_ps(Far, Reflected), _mm_andnot_ps(Far, y));
+		__m128 const x = _mm_mul_ps(y, _mm_set1_ps(6.283185307179586f));
+		__m128 const x2 = _mm_mul_ps(x, x);
+
+		__m128 s = _mm_set1_ps(-1.0f / 39916800.0f);
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.0f / 362880.0f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.0f / 5040.0f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.0f / 120.0f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.0f / 6.0f));
+		Sin = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+
+		__m128 c = _mm_set1_ps(1.0f / 479001600.0f);
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.0f / 3628800.0f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f / 40320.0f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.0f / 720.0f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f / 24.0f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-0.5f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f));
+		Cos = _mm_xor_ps(c, _mm_and_ps(Far, SignBit));
+	}
+#	else
+	GLM_FUNC_QUALIFIER void unitRand4(xoshiro128p_x4 & Generator, float Out[4])
+	{
+		uint32 Bits[4];
+		Generator.next(Bits);
+		for(int l = 0; l < 4; ++l)
+			Out[l] = static_cast<float>(Bits[l] >> 8u) * (1.0f / 16777216.0f);
+	}
+#	endif
+}//namespace detail
+
+	template <typename genType, typename genRNG>
+	GLM_FUNC_QUALIFIER genType linearRand(genType Min, genType Max, genRNG & Generator)
+	{
+		return detail::compute_linearRandGen<genType>::call(Min, Max, Generator);
+	}
+
+	template <typename T, precision P, template <typename, precision> class vecType, typename genRNG>
+	GLM_FUNC_QUALIFIER vecType<T, P> linearRand(vecType<T, P> const & Min, vecType<T, P> const & Max, genRNG & Generator)
+	{
+		vecType<T, P> Result(Min);
+		for(length_t i = 0; i < Result.length(); ++i)
+			Result[i] = linearRand(Min[i], Max[i], Generator);
+		return Result;
+	}
+
+	template <typename genType, typename genRNG>
+	GLM_FUNC_QUALIFIER genType gaussRand(genType Mean, genType Deviation, genRNG & Generator)
+	{
+		genType w, x1, x2;
+
+		do
+		{
+			x1 = linearRand(genType(-1), genType(1), Generator);
+			x2 = linearRand(genType(-1), genType(1), Generator);
+
+			w = x1 * x1 + x2 * x2;
+		} while(w > genType(1) || w == genType(0));
+
+		return x2 * Deviation * sqrt((genType(-2) * log(w)) / w) + Mean;
+	}
+
+	template <typename T, typename genRNG>
+	GLM_FUNC_QUALIFIER tvec2<T, defaultp> diskRand(T Radius, genRNG & Generator)
+	{
+		tvec2<T, defaultp> Result(T(0));
+
+		do
+		{
+			Result = linearRand(
+				tvec2<T, defaultp>(-Radius),
+				tvec2<T, defaultp>(Radius),
+				Generator);
+		}
+		while(length(Result) > Radius);
+
+		return Result;
+	}
+
+	template <typename T, typename genRNG>
+	GLM_FUNC_QUALIFIER tvec3<T, defaultp> ballRand(T Radius, genRNG & Generator)
+	{
+		tvec3<T, defaultp> Result(T(0));
+
+		do
+		{
+			Result = linearRand(
+				tvec3<T, defaultp>(-Radius),
+				tvec3<T, defaultp>(Radius),
+				Generator);
+		}
+		while(length(Result) > Radius);
+
+		return Result;
+	}
+
+	template <typename T, typename genRNG>
+	GLM_FUNC_QUALIFIER tvec2<T, defaultp> circularRand(T Radius, genRNG & Generator)
+	{
+		T a = linearRand(T(0), T(6.283185307179586476925286766559f), Generator);
+		return tvec2<T, defaultp>(cos(a), sin(a)) * Radius;
+	}
+
+	template <typename T, typename genRNG>
+	GLM_FUNC_QUALIFIER tvec3<T, defaultp> sphericalRand(T Radius, genRNG & Generator)
+	{
+		T z = linearRand(T(-1), T(1), Generator);
+		T a = linearRand(T(0), T(6.283185307179586476925286766559f), Generator);
+
+		T r = sqrt(T(1) - z * z);
+
+		return tvec3<T, defaultp>(r * cos(a), r * sin(a), z) * Radius;
+	}
+
+	// The batched functions make four values per step; a last partial step
+	// draws four and keeps what fits
+
+	GLM_FUNC_QUALIFIER void linearRand(float * Result, std::size_t Count, float Min, float Max, xoshiro128p_x4 & Generator)
+	{
+#		if GLM_ARCH & GLM_ARCH_SSE2_BIT
+			__m128 const Scale = _mm_set1_ps(Max - Min);
+			__m128 const Offset = _mm_set1_ps(Min);
+			std::size_t i = 0;
+			for(; i + 4 <= Count; i += 4)
+				_mm_storeu_ps(Result + i, _mm_add_ps(_mm_mul_ps(detail::unitRand4(Generator), Scale), Offset));
+			if(i < Count)
+			{
+				float Last[4];
+				_mm_storeu_ps(Last, _mm_add_ps(_mm_mul_ps(detail::unitRand4(Generator), Scale), Offset));
+				for(std::size_t j = 0; i + j < Count; ++j)
+					Result[i + j] = Last[j];
+			}
+#		else
+			for(std::size_t i = 0; i < Count; i += 4)
+			{
+				float u[4];
+				detail::unitRand4(Generator, u);
+				for(std::size_t j = 0; j < 4 && i + j < Count; ++j)
+					Result[i + j] = u[j] * (Max - Min) + Min;
+			}
+#		endif
+	}
+
+	GLM_FUNC_QUALIFIER void circularRand(tvec2<float, defaultp> * Result, std::size_t Count, float Radius, xoshiro128p_x4 & Generator)
+	{
+		for(std::size_t i = 0; i < Count; i += 4)
+		{
+			float x[4], y[4];
+#			if GLM_ARCH & GLM_ARCH_SSE2_BIT
+				__m128 Cos, Sin;
+				detail::cosSin2Pi(detail::unitRand4(Generator), Cos, Sin);
+				_mm_storeu_ps(x, _mm_mul_ps(Cos, _mm_set1_ps(Radius)));
+				_mm_storeu_ps(y, _mm_mul_ps(Sin, _mm_set1_ps(Radius)));
+#			else
+				float u[4];
+				detail::unitRand4(Generator, u);
+				for(int l = 0; l < 4; ++l)
+				{
+					x[l] = cos(u[l] * 6.283185307179586f) * Radius;
+					y[l] = sin(u[l] * 6.283185307179586f) * Radius;
+				}
+#			endif
+			for(std::size_t j = 0; j < 4 && i + j < Count; ++j)
+				Result[i + j] = tvec2<float, defaultp>(x[j], y[j]);
+		}
+	}
+
+	GLM_FUNC_QUALIFIER void sphericalRand(tvec3<float, defaultp> * Result, std::size_t Count, float Radius, xoshiro128p_x4 & Generator)
+	{
+		for(std::size_t i = 0; i < Count; i += 4)
+		{
+			float x[4], y[4], z[4];
+#			if GLM_ARCH & GLM_ARCH_SSE2_BIT
+				__m128 const Z = _mm_sub_ps(_mm_mul_ps(detail::unitRand4(Generator), _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f));
+				__m128 const R = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(Z, Z))), _mm_set1_ps(Radius));
+				__m128 Cos, Sin;
+				detail::cosSin2Pi(detail::unitRand4(Generator), Cos, Sin);
+				_mm_storeu_ps(x, _mm_mul_ps(Cos, R));
+				_mm_storeu_ps(y, _mm_mul_ps(Sin, R));
+				_mm_storeu_ps(z, _mm_mul_ps(Z, _mm_set1_ps(Radius)));
+#			else
+				float u[4], v[4];
+				detail::unitRand4(Generator, u);
+				detail::unitRand4(Generator, v);
+				for(int l = 0; l < 4; ++l)
+				{
+					z[l] = u[l] * 2.0f - 1.0f;
+					float const r = sqrt(1.0f - z[l] * z[l]) * Radius;
+					x[l] = cos(v[l] * 6.283185307179586f) * r;
+					y[l] = sin(v[l] * 6.283185307179586f) * r;
+					z[l] *= Radius;
+				}
+#			endif
+			for(std::size_t j = 0; j < 4 && i + j < Count; ++j)
+				Result[i + j] = tvec3<float, defaultp>(x[j], y[j], z[j]);
+		}
+	}
 }//namespace glm
@@ -0,0 +1,88 @@
+// ==========================================================================
+// Light hierarchy for scenes with many point lights
+// ==========================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include "lighttree.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+float power(const Light &light){
+	return dot(light.color, vec3(0.299f, 0.587f, 0.114f));
+}
+
+float intBits(int value){
+	float bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+//Fills in the node at slot for lights order[first, last), splitting them at
+//the median of the longest axis of their box. Returns the levels below it
+int buildNode(const vector<Light> &lights, vector<int> &order, int first, int last, int slot, LightTree &tree){
+	vec3 low(1e30f), high(-1e30f);
+	float total = 0.f;
+	for (int i = first; i < last; i++){
+		low = min(low, lights[order[i]].pos);
+		high = max(high, lights[order[i]].pos);
+		total += power(lights[order[i]]);
+	}
+	tree.nodes[2*slot] = vec4(low, total);
+	if (last - first == 1){
+		tree.nodes[2*slot + 1] = vec4(high, intBits(-(order[first] + 1)));
+		return 0;
+	}
+
+	vec3 extent = high - low;
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+	int middle = (first + last)/2;
+	nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+	            [&](int a, int b){ return lights[a].pos[axis] < lights[b].pos[axis]; });
+
+	int child = int(tree.nodes.size()/2);
+	tree.nodes.resize(tree.nodes.size() + 4);
+	tree.nodes[2*slot + 1] = vec4(high, intBits(child));
+	int left = buildNode(lights, order, first, middle, child, tree);
+	int right = buildNode(lights, order, middle, last, child + 1, tree);
+	return 1 + std::max(left, right);
+}
+
+}
+
+LightTree buildLightTree(const vector<Light> &lights){
+	LightTree tree;
+	tree.depth = 0;
+	if (lights.empty())
+		return tree;
+	for (const Light &light : lights){
+		tree.lights.push_back(vec4(light.pos, 1.f));
+		tree.lights.push_back(vec4(light.color, 0.f));
+	}
+	vector<int> order(lights.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = int(i);
+	tree.nodes.reserve(4*lights.size());
+	tree.nodes.resize(2);
+	tree.depth = buildNode(lights, order, 0, int(lights.size()), 0, tree);
+	return tree;
+}
+
+vector<Light> randomLights(int count, vec3 low, vec3 high, float scale, unsigned seed){
+	mt19937 generator(seed);
+	uniform_real_distribution<float> unit(0.f, 1.f);
+	vector<Light> lights(count);
+	for (Light &light : lights){
+		light.pos = low + (high - low)*vec3(unit(generator), unit(generator), unit(generator));
+		//a hue on the colour wheel, mixed with white
+		float hue = 6.f*unit(generator);
+		vec3 color = clamp(vec3(fabs(hue - 3.f) - 1.f, 2.f - fabs(hue - 2.f), 2.f - fabs(hue - 4.f)), 0.f, 1.f);
+		light.color = mix(color, vec3(1.f), 0.5f)*(scale/count);
+	}
+	return lights;
+}
@@ -0,0 +1,33 @@
+// ==========================================================================
+// Light hierarchy for scenes with many point lights
+//
+// A binary tree over the scene's lights: every node bounds the positions of
+// its lights and sums their power (the luminance of their colours). The GLSL
+// tracer walks it from the root to one light per shadow ray, taking each child
+// with probability proportional to what it can contribute at the shaded point,
+// so a sample costs the depth of the tree instead of a pass over every light.
+// ==========================================================================
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "scene.h"
+
+//Flattened for two RGBA32F buffer textures. A node is two texels: its box
+//minimum and power, then its box maximum and the bits of an int, the index of
+//its first child (the second follows it) or -(light + 1) for a leaf. A light
+//is its position and its colour
+struct LightTree{
+	std::vector<glm::vec4> nodes;
+	std::vector<glm::vec4> lights;
+	int depth;		//Levels below the root
+};
+
+LightTree buildLightTree(const std::vector<Light> &lights);
+
+//count lights at random positions in the box low..high, with random hues and
+//colours scaled by scale/count so the total stays the same as count grows
+std::vector<Light> randomLights(int count, glm::vec3 low, glm::vec3 high, float scale, unsigned seed);
+
+#endif
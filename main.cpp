@@ -16,13 +16,33 @@
 #include <iterator>
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <deque>
 #include "glm/glm.hpp"
+#include "scene.h"
+#include "tracer.h"
+#include "distributed.h"
+#include "cpurender.h"
+#include "lighttree.h"
+#include "bluenoise.h"
+#include "sampler.h"
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // specify that we want the OpenGL core profile before including GLFW headers
 #define GLFW_INCLUDE_GLCOREARB
 #define GL_GLEXT_PROTOTYPES
 #include <GLFW/glfw3.h>
 
+// EGL provides the windowless context for --offscreen
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -39,32 +59,57 @@ void QueryGLVersion();
 string LoadSource(const string &filename);
 GLuint CompileShader(GLenum shaderType, const string &source);
 GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
+GLuint BuildProgram(const string &vertexSource, const string &fragmentSource, bool &fromCache);
+GLuint BuildComputeProgram(const string &computeSource, bool &fromCache);
+void setDrawBuffers();
 
 GLFWwindow* window = 0;
-
-vector<vec3> triangleVecs;
-vector<vec3> sphereVecs;
-vector<vec3> planeVecs;
-vector<vec3> lightVecs;
+const char *WINDOW_TITLE = "Susant Pant A4";
 
 vector<vec2> points;
 vector<vec2> uvs;
 
 struct VAO{
-	enum {LINES=0, COUNT};		//Enumeration assigns each name a value going up
+	enum {LINES=0, PRIMITIVES, COUNT};		//Enumeration assigns each name a value going up
 };
 
 struct VBO{
-	enum {POINTS=0, COLOR, COUNT};	//POINTS=0, COLOR=1, COUNT=2
+	enum {POINTS=0, COLOR, PRIMITIVES, COUNT};	//POINTS=0, COLOR=1, PRIMITIVES=2, COUNT=3
 };
 
 struct SHADER{
-	enum {LINE=0, COUNT};		//LINE=0, COUNT=1
+	enum {LINE=0, REFINE, ACCUMULATE, GBUFFER, COUNT};		//LINE=0, REFINE=1, ACCUMULATE=2, GBUFFER=3, COUNT=4
+};
+
+struct PASS{
+	enum {GBUFFER=0, TRACE, REFINE, AA, ACCUM, PRESENT, COUNT};	//GPU passes render() times, REFINE is the stretch or scatter of a progressive pass
+};
+
+struct FBO{
+	enum {TRACE=0, LOWRES, AA, ACCUM0, ACCUM1, HISTORY, GBUFFER, COUNT};	//TRACE keeps the image between frames, LOWRES holds reduced density passes, AA the anti-aliased image, ACCUM0/1 the running average and the one before it, HISTORY the previous trace while reprojecting, GBUFFER the rasterized primary hits
 };
 
 GLuint vbo [VBO::COUNT];		//Array which stores OpenGL's vertex buffer object handles
 GLuint vao [VAO::COUNT];		//Array which stores Vertex Array Object handles
 GLuint shader [SHADER::COUNT];		//Array which stores shader program handles
+GLuint fbo [FBO::COUNT];		//Array which stores framebuffer object handles
+GLuint fboTex [FBO::COUNT];		//Colour textures attached to each framebuffer
+GLuint gbufferDepth = 0;		//Depth renderbuffer of the G-buffer
+GLuint counterTex [2] = {0, 0};		//Ray counter targets, attached to TRACE and AA while counting
+bool countersEnabled = false;
+GLuint hitTex [2] = {0, 0};		//Primary hits of the TRACE and HISTORY targets while reprojecting
+bool reprojection = false;		//Reuse shading of the previous frame while the camera moves
+GLuint tileTex [2] = {0, 0};		//Offset and length of each tile's primitive list, and the lists
+GLuint tileBuffer = 0;		//Storage of the lists' buffer texture
+GLuint lightTex [2] = {0, 0};		//Light tree nodes and lights, buffer textures of the many lights path
+GLuint lightBuffer [2] = {0, 0};
+GLuint blueNoiseTex = 0;		//Blue-noise masks for the area light samples
+GLuint passQuery [2][PASS::COUNT];		//GL_TIME_ELAPSED query per pass, for two frames in flight
+
+int fbWidth = 512;
+int fbHeight = 512;
+int traceWidth = 512;		//Part of the targets the tracer fills, smaller than the
+int traceHeight = 512;		//framebuffer while dynamic resolution is scaling down
 
 //Gets handles from OpenGL
 void generateIDs()
@@ -73,16 +118,41 @@ void generateIDs()
 	glGenBuffers(VBO::COUNT, vbo);
 }
 
+string vertexSource;		//Shared by every program variant
+string fragmentTemplate;		//fragment.glsl before the scene's #defines are inserted
+string computeTemplate;		//compute.glsl, empty when the context is older than 4.3
+bool computeTracer = false;		//Trace with the compute program instead of the fullscreen quad
+bool sharedPrimitives = false;		//Compute tracer copies the scene to shared memory per tile
+bool hybridRendering = false;		//Rasterize primary visibility, trace only shadows and reflections
+int tileBinning = 0;		//Primary rays search per screen tile lists: 0 off, 1 on, 2 showing their lengths
+map<string, GLuint> programVariants;		//Linked tracer programs keyed by their #define block
+
 //Clean up IDs when you're done using them
 void deleteIDs()
 {
 	for(int i=0; i<SHADER::COUNT; i++)
 	{
-		glDeleteProgram(shader[i]);
+		if (i != SHADER::LINE)
+			glDeleteProgram(shader[i]);
 	}
+	//LINE is always one of the cached variants
+	for (auto &variant : programVariants)
+		glDeleteProgram(variant.second);
+	programVariants.clear();
 	
 	glDeleteVertexArrays(VAO::COUNT, vao);
 	glDeleteBuffers(VBO::COUNT, vbo);	
+	glDeleteFramebuffers(FBO::COUNT, fbo);
+	glDeleteTextures(FBO::COUNT, fboTex);
+	glDeleteRenderbuffers(1, &gbufferDepth);
+	glDeleteTextures(2, counterTex);
+	glDeleteTextures(2, hitTex);
+	glDeleteTextures(2, tileTex);
+	glDeleteBuffers(1, &tileBuffer);
+	glDeleteTextures(2, lightTex);
+	glDeleteTextures(1, &blueNoiseTex);
+	glDeleteBuffers(2, lightBuffer);
+	glDeleteQueries(2*PASS::COUNT, &passQuery[0][0]);
 }
 
 //Describe the setup of the Vertex Array Object
@@ -112,6 +182,15 @@ bool initVAO()
 		(void*)0
 		);	
 
+	//Scene primitives for the G-buffer pass, see loadPrimitiveBuffer
+	glBindVertexArray(vao[VAO::PRIMITIVES]);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo[VBO::PRIMITIVES]);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 7*sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 7*sizeof(float), (void*)(4*sizeof(float)));
+	glBindVertexArray(vao[VAO::LINES]);
+
 	return !CheckGLErrors("initVAO");		//Check for errors in initialize
 }
 
@@ -138,20 +217,107 @@ bool loadBuffer(const vector<vec2>& points, const vector<vec2>& colors)
 	return !CheckGLErrors("loadBuffer");	
 }
 
-//Compile and link shaders, storing the program ID in shader array
+//Replaces each #include "file" line with the contents of that file and the
+//files it includes in turn, GLSL has no include directive of its own
+string expandIncludes(const string &source)
+{
+	string expanded;
+	size_t lineStart = 0;
+	while (lineStart < source.size()){
+		size_t lineEnd = source.find('\n', lineStart);
+		if (lineEnd == string::npos)
+			lineEnd = source.size();
+		string line = source.substr(lineStart, lineEnd - lineStart);
+		size_t open = line.find('"');
+		size_t close = line.rfind('"');
+		if (line.compare(0, 8, "#include") == 0 && open != string::npos && close > open)
+			expanded += expandIncludes(LoadSource(line.substr(open + 1, close - open - 1))) + "\n";
+		else
+			expanded += line + "\n";
+		lineStart = lineEnd + 1;
+	}
+	return expanded;
+}
+
+//Compile and link shaders, storing the program ID in shader array. The tracer
+//program itself is only built once a scene is loaded (see useVariant)
 bool initShader()
 {	
-	string vertexSource = LoadSource("vertex.glsl");		//Put vertex file text into string
-	string fragmentSource = LoadSource("fragment.glsl");		//Put fragment file text into string
+	vertexSource = LoadSource("vertex.glsl");		//Put vertex file text into string
+	fragmentTemplate = expandIncludes(LoadSource("fragment.glsl"));		//Put fragment file text into string
 
-	GLuint vertexID = CompileShader(GL_VERTEX_SHADER, vertexSource);
-	GLuint fragmentID = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
-	
-	shader[SHADER::LINE] = LinkProgram(vertexID, fragmentID);	//Link and store program ID in shader array
+	//The compute tracer needs 4.3, 4.1 contexts (macOS) only get the fragment one
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 3))
+		computeTemplate = expandIncludes(LoadSource("compute.glsl"));
+
+	string refineSource = LoadSource("refine.glsl");
+	bool fromCache;
+	shader[SHADER::REFINE] = BuildProgram(vertexSource, refineSource, fromCache);
+
+	string accumulateSource = LoadSource("accumulate.glsl");
+	shader[SHADER::ACCUMULATE] = BuildProgram(vertexSource, accumulateSource, fromCache);
+
+	string gbufferVertexSource = LoadSource("gbuffervertex.glsl");
+	string gbufferSource = LoadSource("gbuffer.glsl");
+	shader[SHADER::GBUFFER] = BuildProgram(gbufferVertexSource, gbufferSource, fromCache);
 
 	return !CheckGLErrors("initShader");
 }
 
+//Inserts a block of #defines straight after the #version line, which has to
+//stay the first statement of the shader
+string specializeSource(const string &source, const string &defines)
+{
+	size_t lineEnd = source.find('\n', source.find("#version"));
+	if (lineEnd == string::npos)
+		return defines + source;
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+//Creates the offscreen targets the tracer renders into. The trace target is only
+//presented to the window, so its contents survive glfwSwapBuffers. All targets
+//hold floats: the temporal averages so hundreds of frames can be added up, the
+//G-buffer so it holds hit points, and the tracer's own so the colours of sampled
+//lights, weighted by 1/probability, reach the average unclamped. The G-buffer
+//gets a depth buffer of its own
+bool initFramebuffers(int width, int height)
+{
+	glGenFramebuffers(FBO::COUNT, fbo);
+	glGenTextures(FBO::COUNT, fboTex);
+	glGenRenderbuffers(1, &gbufferDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, gbufferDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	for (int i = 0; i < FBO::COUNT; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, fboTex[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTex[i], 0);
+		if (i == FBO::GBUFFER)
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gbufferDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "ERROR: framebuffer " << i << " is incomplete" << endl;
+
+		glClearColor(0.f, 0.f, 0.f, 0.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return !CheckGLErrors("initFramebuffers");
+}
+
 //For reference:
 //	https://open.gl/textures
 GLuint createTexture(const char* filename)
@@ -219,6 +385,109 @@ float lookRight = 0.f;
 bool focus = false;
 bool scene3 = false;
 
+//Thin lens depth of field, on while F is toggled on except in scene 3. It
+//always averages frames, see temporal accumulation
+float aperture = 0.1f;		//Lens radius
+float focusDistance = 7.f;		//Distance of the sharp plane along the view axis
+
+bool depthOfField()
+{
+	return focus && !scene3;
+}
+
+//Reflection budget, the defaults trace every bounce like the original tracer
+int maxBounces = 20;
+float minReflCoeff = 0.f;		//Stop once the next bounce would contribute less than this
+int rouletteDepth = 0;		//Russian roulette after this many bounces, 0 disables it
+
+//Many lights: scenes with more than one light sample them from a light tree
+int generatedLights = 0;		//Replace the scene's lights with this many random ones
+int lightSamples = 1;		//Shadow rays per shading point, 0 traces one to every light
+
+//Area lights: scenes with rectangular or spherical lights average shadow rays
+//to points spread over them, and their point lights become lights of size zero
+int areaSamples = 4;		//Shadow rays per light and shading point, a square number
+const int MAX_AREA_LIGHTS = 8;
+
+int numAreaLights()
+{
+	if (areaLightVecs.empty())
+		return 0;
+	return (int)std::min<size_t>(areaLightVecs.size()/4 + lightVecs.size()/2, MAX_AREA_LIGHTS);
+}
+
+bool manyLights()
+{
+	return numAreaLights() == 0 && (generatedLights > 0 || lightVecs.size()/2 > 1);
+}
+
+//Scene 3 was tuned without an epsilon on secondary rays, see KeyCallback
+bool isScene3(const string &filename)
+{
+	return filename.size() >= 10 && filename.compare(filename.size() - 10, 10, "scene3.txt") == 0;
+}
+
+//Any primitive with a nonzero reflection coefficient (the z of its last vec)
+bool hasReflections(const vector<vec3> &vecs, unsigned stride)
+{
+	for (unsigned i = stride - 1; i < vecs.size(); i += stride){
+		if (vecs[i].z != 0.f)
+			return true;
+	}
+	return false;
+}
+
+//Compile-time description of the loaded scene: primitive counts become loop
+//bounds and unused features are compiled out of the tracer
+string shaderDefines()
+{
+	bool reflections = hasReflections(triangleVecs, 5) || hasReflections(sphereVecs, 4) || hasReflections(planeVecs, 4);
+	string defines;
+	defines += "#define NUM_TRIANGLES " + to_string(std::min<size_t>(triangleVecs.size()/5, 50)) + "\n";
+	defines += "#define NUM_SPHERES " + to_string(std::min<size_t>(sphereVecs.size()/4, 10)) + "\n";
+	defines += "#define NUM_PLANES " + to_string(std::min<size_t>(planeVecs.size()/4, 2)) + "\n";
+	defines += string("#define ENABLE_REFLECTIONS ") + (reflections ? "1" : "0") + "\n";
+	defines += string("#define ENABLE_DOF ") + (depthOfField() ? "1" : "0") + "\n";
+	defines += string("#define ENABLE_COUNTERS ") + (countersEnabled ? "1" : "0") + "\n";
+	defines += string("#define ENABLE_REPROJECTION ") + (reprojection ? "1" : "0") + "\n";
+	defines += string("#define ENABLE_GBUFFER ") + (hybridRendering && !depthOfField() ? "1" : "0") + "\n";
+	defines += string("#define ENABLE_TILE_LISTS ") + (tileBinning > 0 && !depthOfField() ? "1" : "0") + "\n";
+	defines += string("#define MANY_LIGHTS ") + (manyLights() ? "1" : "0") + "\n";
+	defines += "#define NUM_AREA_LIGHTS " + to_string(numAreaLights()) + "\n";
+	defines += string("#define BORDER ") + (scene3 ? "0.0" : "0.001") + "\n";
+	if (computeTracer)
+		defines += string("#define SHARED_PRIMITIVES ") + (sharedPrimitives ? "1" : "0") + "\n";
+	return defines;
+}
+
+//Makes the tracer variant for the current scene and toggles active, building it
+//the first time it is needed. Returns true when the program changed, in which
+//case the geometry and camera uniforms have to be uploaded again
+bool useVariant()
+{
+	string defines = shaderDefines();
+	string key = (computeTracer ? "compute\n" : "fragment\n") + defines;
+	GLuint program;
+	auto found = programVariants.find(key);
+	if (found != programVariants.end()){
+		program = found->second;
+	}
+	else {
+		auto start = chrono::steady_clock::now();
+		bool fromCache;
+		if (computeTracer)
+			program = BuildComputeProgram(specializeSource(computeTemplate, defines), fromCache);
+		else
+			program = BuildProgram(vertexSource, specializeSource(fragmentTemplate, defines), fromCache);
+		programVariants[key] = program;
+		cout << (fromCache ? "Loaded" : "Built") << " shader variant " << programVariants.size() << " in "
+		     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+	}
+	bool changed = (program != shader[SHADER::LINE]);
+	shader[SHADER::LINE] = program;
+	return changed;
+}
+
 bool loadUniforms()
 {
 	glUseProgram(shader[SHADER::LINE]);
@@ -239,123 +508,1340 @@ bool loadUniforms()
 	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "yRot");
 	glUniform1f(uniformLocation, lookRight);
 
-	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "brokenFocus");
-	glUniform1f(uniformLocation, focus);
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "maxBounces");
+	glUniform1i(uniformLocation, maxBounces);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "minReflCoeff");
+	glUniform1f(uniformLocation, minReflCoeff);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "rouletteDepth");
+	glUniform1i(uniformLocation, rouletteDepth);
+
+	return !CheckGLErrors("loadUniforms");
+}
+
+// --------------------------------------------------------------------------
+// Progressive refinement
+//
+// While the camera moves only one pixel per stride x stride block is traced (1/4
+// or 1/16 of the pixels) and stretched over its block. Once the camera stops, each
+// following frame traces one more pixel of every block until the image is complete.
+
+int progressiveStride = 1;	//1 disables progressive rendering, 2 or 4 enable it
+int refinePass = 0;		//Number of interleaved passes already in the trace target
+bool viewChanged = true;	//Set whenever the traced image no longer matches the view
+bool redrawPending = true;	//Set when the window needs the last image presented again
+
+//Bayer ordered-dither rank of pixel (x, y) inside a stride x stride block, so
+//consecutive refinement passes are spread evenly over the block
+int bayerIndex(int x, int y, int stride)
+{
+	if (stride <= 1)
+		return 0;
+	int half = stride/2;
+	static const int quadrant[2][2] = {{0, 3}, {2, 1}};	//Indexed [x][y]
+	return 4*bayerIndex(x % half, y % half, half) + quadrant[x/half][y/half];
+}
+
+//Offset inside a block of the pixel traced by the given refinement pass
+ivec2 refineOffset(int pass, int stride)
+{
+	for (int y = 0; y < stride; y++)
+		for (int x = 0; x < stride; x++)
+			if (bayerIndex(x, y, stride) == pass)
+				return ivec2(x, y);
+	return ivec2(0, 0);
+}
+
+//Sets the uniforms which select which pixels a trace pass covers
+void loadPassUniforms(int width, int height, int sampleStride, ivec2 sampleOffset)
+{
+	GLint uniformLocation;
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "resolution");
+	glUniform2f(uniformLocation, float(width), float(height));
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "sampleStride");
+	glUniform1i(uniformLocation, sampleStride);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "sampleOffset");
+	glUniform2i(uniformLocation, sampleOffset.x, sampleOffset.y);
+}
+
+//Runs a pass of the compute tracer over width x height pixels of the given
+//target, in 8x8 tiles. The barrier makes the image writes visible to the blits,
+//texture reads and read backs that follow
+void dispatchTrace(int target, int width, int height)
+{
+	glBindImageTexture(0, fboTex[target], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	if (countersEnabled){
+		glBindImageTexture(1, counterTex[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+		glBindImageTexture(2, counterTex[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+	}
+	if (reprojection)
+		glBindImageTexture(3, (target == FBO::TRACE) ? hitTex[0] : 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute((width + 7)/8, (height + 7)/8, 1);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+//Traces every pixel into the trace target
+void traceFull()
+{
+	loadPassUniforms(traceWidth, traceHeight, 1, ivec2(0, 0));
+	if (computeTracer){
+		dispatchTrace(FBO::TRACE, traceWidth, traceHeight);
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::TRACE]);
+	glViewport(0, 0, traceWidth, traceHeight);
+	glDrawArrays(GL_TRIANGLES, 0, points.size());
+}
+
+//Traces the pixel at offset in every stride x stride block into the low resolution
+//target. Tracing the subset densely keeps neighbouring fragments doing useful work,
+//where discarding the other pixels of a full resolution pass would not save anything
+void traceLowRes(int stride, ivec2 offset)
+{
+	int lowWidth = (traceWidth + stride - 1)/stride;
+	int lowHeight = (traceHeight + stride - 1)/stride;
+	loadPassUniforms(traceWidth, traceHeight, stride, offset);
+	if (computeTracer){
+		dispatchTrace(FBO::LOWRES, lowWidth, lowHeight);
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::LOWRES]);
+	glViewport(0, 0, lowWidth, lowHeight);
+	glDrawArrays(GL_TRIANGLES, 0, points.size());
+}
+
+//Only the colour attachment of the trace target, for the passes that copy the
+//low resolution colour into it. With counters on, attachments 1 and 2 are
+//integer textures a float blit cannot write, and refine.glsl has no outputs
+//for them. setDrawBuffers() restores the rest
+void drawColourOnly()
+{
+	const GLenum colour = GL_COLOR_ATTACHMENT0;
+	glDrawBuffers(1, &colour);
+}
+
+//Stretches the low resolution pass over whole blocks of the trace target
+void stretchLowRes(int stride)
+{
+	int lowWidth = (traceWidth + stride - 1)/stride;
+	int lowHeight = (traceHeight + stride - 1)/stride;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[FBO::LOWRES]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[FBO::TRACE]);
+	drawColourOnly();
+	glBlitFramebuffer(0, 0, lowWidth, lowHeight, 0, 0, lowWidth*stride, lowHeight*stride, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	setDrawBuffers();
+}
+
+//Writes the low resolution pass into the pixels it was traced for
+void scatterLowRes(int stride, ivec2 offset)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::TRACE]);
+	drawColourOnly();
+	glViewport(0, 0, traceWidth, traceHeight);
+
+	glUseProgram(shader[SHADER::REFINE]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fboTex[FBO::LOWRES]);
+
+	GLint uniformLocation;
+	uniformLocation = glGetUniformLocation(shader[SHADER::REFINE], "lowRes");
+	glUniform1i(uniformLocation, 0);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::REFINE], "stride");
+	glUniform1i(uniformLocation, stride);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::REFINE], "offset");
+	glUniform2i(uniformLocation, offset.x, offset.y);
+
+	glDrawArrays(GL_TRIANGLES, 0, points.size());
+	setDrawBuffers();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(shader[SHADER::LINE]);
+}
+
+// --------------------------------------------------------------------------
+// Temporal accumulation
+//
+// While the view stays the same every frame traces the image again through a
+// new point of each pixel (and of the lens with DoF), the next of a Sobol
+// sequence scrambled per pixel (sampler.h), and adds it to the running average
+// of the frames since the last change, up to MAX_ACCUM_FRAMES.
+// The average ping-pongs between the two float targets: the accumulate
+// program reads the new frame and the previous average and writes the next.
+// Any change to the view starts over. Toggled with T, always on with DoF and
+// area lights.
+
+bool temporalAccumulation = false;
+const int MAX_ACCUM_FRAMES = 256;
+int accumFrames = 0;		//Frames averaged so far, the next frame's frameIndex
+int accumTarget = FBO::ACCUM0;		//Target holding the current average
+
+bool accumulating()
+{
+	return temporalAccumulation || depthOfField() || numAreaLights() > 0;
+}
+
+//Per frame uniforms of the tracer: the frame's index in the average and the lens
+void loadFrameUniforms()
+{
+	GLint uniformLocation;
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "frameIndex");
+	glUniform1i(uniformLocation, accumFrames);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "aperture");
+	glUniform1f(uniformLocation, aperture);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "focusDistance");
+	glUniform1f(uniformLocation, focusDistance);
+
+	if (manyLights()){
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "lightNodes");
+		glUniform1i(uniformLocation, 7);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "lightList");
+		glUniform1i(uniformLocation, 8);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "lightSamples");
+		glUniform1i(uniformLocation, lightSamples);
+	}
+
+	if (numAreaLights() > 0){
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "blueNoise");
+		glUniform1i(uniformLocation, 9);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "areaSamples");
+		glUniform1i(uniformLocation, areaSamples);
+	}
+}
+
+//Adds the trace target to the average, weighting it 1/(n+1)
+void accumulate()
+{
+	int history = accumTarget;
+	accumTarget = (history == FBO::ACCUM0) ? FBO::ACCUM1 : FBO::ACCUM0;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[accumTarget]);
+	glViewport(0, 0, traceWidth, traceHeight);
+
+	glUseProgram(shader[SHADER::ACCUMULATE]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fboTex[FBO::TRACE]);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, fboTex[history]);
+
+	GLint uniformLocation;
+	uniformLocation = glGetUniformLocation(shader[SHADER::ACCUMULATE], "frame");
+	glUniform1i(uniformLocation, 0);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::ACCUMULATE], "history");
+	glUniform1i(uniformLocation, 1);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::ACCUMULATE], "weight");
+	glUniform1f(uniformLocation, 1.f/(accumFrames + 1));
+
+	glDrawArrays(GL_TRIANGLES, 0, points.size());
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(shader[SHADER::LINE]);
+	accumFrames++;
+}
+
+// --------------------------------------------------------------------------
+// Temporal reprojection
+//
+// While the camera moves, every full trace also writes the primary hit of each
+// pixel (point and object) to a float target next to the colour. The next trace
+// copies both to the history targets, projects its own primary hits into the
+// previous camera and, where that pixel saw the same object at the same point,
+// takes its colour instead of shading and reflecting the hit again. One 8x8
+// pixel tile of every 4x4 tiles is always shaded (refreshPhase), so no reused
+// colour is more than 16 frames old, and once the camera stops the view is
+// traced again without reuse. Only the camera may differ between the two
+// frames: anything else that changes the image drops the history. Toggled with
+// V, not used with progressive refinement or while averaging.
+
+struct History{
+	bool valid;		//The trace target holds a trace this state describes
+	float xPos, yPos, zPos, lookUp, lookRight;
+	int width, height;
+	GLuint program;
+	int maxBounces;
+	float minReflCoeff;
+	int rouletteDepth;
+};
+
+History history = {};
+int refreshPhase = 0;		//8x8 tile of each 4x4 tiles the next reprojected trace shades anyway
+bool reprojectedImage = false;		//Set while the trace target holds reused colours
+
+//Something other than a trace with reprojection wrote the trace target
+void dropHistory()
+{
+	history.valid = false;
+	reprojectedImage = false;
+}
+
+//Draw buffers of the trace and AA targets: the colour, the ray counters while
+//counting and, for the trace target, the primary hits while reprojecting
+void setDrawBuffers()
+{
+	const int targets[2] = {FBO::TRACE, FBO::AA};
+	for (int target : targets){
+		GLenum drawBuffers[4] = {GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE, GL_NONE};
+		if (countersEnabled){
+			drawBuffers[1] = GL_COLOR_ATTACHMENT1;
+			drawBuffers[2] = GL_COLOR_ATTACHMENT2;
+		}
+		if (reprojection && target == FBO::TRACE)
+			drawBuffers[3] = GL_COLOR_ATTACHMENT3;
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[target]);
+		glDrawBuffers(4, drawBuffers);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//Creates the primary hit targets, attachment 3 of the trace framebuffer and
+//attachment 1 of the history framebuffer
+void initReprojectionTargets()
+{
+	glDeleteTextures(2, hitTex);
+	glGenTextures(2, hitTex);
+	for (int i = 0; i < 2; i++){
+		glBindTexture(GL_TEXTURE_2D, hitTex[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, fbWidth, fbHeight, 0, GL_RGBA, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	const int targets[2] = {FBO::TRACE, FBO::HISTORY};
+	const GLenum attachments[2] = {GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT1};
+	for (int i = 0; i < 2; i++){
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[targets[i]]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, hitTex[i], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "ERROR: reprojection framebuffer " << targets[i] << " is incomplete" << endl;
+	}
+	setDrawBuffers();
+	dropHistory();
+	CheckGLErrors("initReprojectionTargets");
+}
+
+void deleteReprojectionTargets()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::TRACE]);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::HISTORY]);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+	setDrawBuffers();
+	glDeleteTextures(2, hitTex);
+	hitTex[0] = hitTex[1] = 0;
+	dropHistory();
+}
+
+//True when the trace target holds the same view except for the camera, so its
+//colours can be reused for the next one
+bool historyUsable()
+{
+	bool cameraMoved = history.xPos != xPos || history.yPos != yPos || history.zPos != zPos
+		|| history.lookUp != lookUp || history.lookRight != lookRight;
+	return history.valid && cameraMoved && !accumulating()
+		&& history.width == traceWidth && history.height == traceHeight
+		&& history.program == shader[SHADER::LINE] && history.maxBounces == maxBounces
+		&& history.minReflCoeff == minReflCoeff && history.rouletteDepth == rouletteDepth;
+}
+
+//Copies the trace target's colours and primary hits to the history targets
+void copyHistory()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[FBO::TRACE]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[FBO::HISTORY]);
+	glBlitFramebuffer(0, 0, traceWidth, traceHeight, 0, 0, traceWidth, traceHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glReadBuffer(GL_COLOR_ATTACHMENT3);
+	glDrawBuffer(GL_COLOR_ATTACHMENT1);
+	glBlitFramebuffer(0, 0, traceWidth, traceHeight, 0, 0, traceWidth, traceHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//Traces every pixel into the trace target, reusing the previous trace's colours
+//where it saw the same surface. The result is the next frame's history
+void traceReprojected()
+{
+	bool reuse = historyUsable();
+	GLint uniformLocation;
+	if (reuse){
+		copyHistory();
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, fboTex[FBO::HISTORY]);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, hitTex[1]);
+		glActiveTexture(GL_TEXTURE0);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "historyColor");
+		glUniform1i(uniformLocation, 2);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "historyHits");
+		glUniform1i(uniformLocation, 3);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "historyPos");
+		glUniform3f(uniformLocation, history.xPos, history.yPos, history.zPos);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "historyRot");
+		glUniform2f(uniformLocation, history.lookUp, history.lookRight);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "refreshPhase");
+		glUniform1i(uniformLocation, refreshPhase);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "reproject");
+		glUniform1i(uniformLocation, 1);
+	}
+
+	traceFull();
+
+	if (reuse){
+		glUniform1i(uniformLocation, 0);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		refreshPhase = (refreshPhase + 1) % 16;
+	}
+	reprojectedImage = reuse;
+
+	//jittered or lens traces are no pinhole view to reproject
+	History traced = {!accumulating(), xPos, yPos, zPos, lookUp, lookRight, traceWidth, traceHeight,
+	                  shader[SHADER::LINE], maxBounces, minReflCoeff, rouletteDepth};
+	history = traced;
+}
+
+// --------------------------------------------------------------------------
+// Hybrid rendering
+//
+// Primary visibility is what rasterization does best, so with Z on a G-buffer
+// pass rasterizes the scene's triangles, and a camera facing quad around each
+// sphere that intersects the pixel's ray analytically, into a float target
+// with a depth buffer: the hit point and id of the primitive seen through
+// every pixel centre. The tracer then intersects its primary ray with that
+// primitive and the planes only (planes are unbounded and stay traced) and
+// follows the shadow and reflection rays as before. Normals and materials are
+// looked up by the id, exactly as the tracer does for its own hits.
+
+int gbufferTriangleVertices = 0;
+int gbufferSphereVertices = 0;
+
+//The G-buffer only serves the pixel centre rays, not the lens of DoF
+bool rasterizing()
+{
+	return hybridRendering && !depthOfField();
+}
+
+//Uploads the scene's triangles and sphere quads for the G-buffer pass, seven
+//floats per vertex: position and radius (spheres), quad corner and id. Ids
+//match the tracer's, objType*1024 + index + 1, for the primitives it keeps
+void loadPrimitiveBuffer()
+{
+	vector<float> vertices;
+	size_t triangles = std::min<size_t>(triangleVecs.size()/5, 50);
+	for (size_t i = 0; i < triangles; i++){
+		for (int corner = 0; corner < 3; corner++){
+			vec3 p = triangleVecs[i*5 + corner];
+			float vertex[7] = {p.x, p.y, p.z, 0.f, 0.f, 0.f, float(i + 1)};
+			vertices.insert(vertices.end(), vertex, vertex + 7);
+		}
+	}
+	gbufferTriangleVertices = int(vertices.size()/7);
+
+	const float corners[6][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, -1}, {1, 1}, {-1, 1}};
+	size_t spheres = std::min<size_t>(sphereVecs.size()/4, 10);
+	for (size_t i = 0; i < spheres; i++){
+		vec3 centre = sphereVecs[i*4];
+		float radius = sphereVecs[i*4 + 1].x;
+		for (int corner = 0; corner < 6; corner++){
+			float vertex[7] = {centre.x, centre.y, centre.z, radius, corners[corner][0], corners[corner][1], float(1024 + i + 1)};
+			vertices.insert(vertices.end(), vertex, vertex + 7);
+		}
+	}
+	gbufferSphereVertices = int(vertices.size()/7) - gbufferTriangleVertices;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo[VBO::PRIMITIVES]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.empty() ? 0 : &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//Rasterizes the current view into the G-buffer and binds it to texture unit 4
+//for the tracer
+void rasterizeGBuffer()
+{
+	GLuint program = shader[SHADER::GBUFFER];
+	glUseProgram(program);
+	glBindVertexArray(vao[VAO::PRIMITIVES]);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::GBUFFER]);
+	glViewport(0, 0, traceWidth, traceHeight);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	GLint uniformLocation;
+	uniformLocation = glGetUniformLocation(program, "xPos");
+	glUniform1f(uniformLocation, xPos);
+
+	uniformLocation = glGetUniformLocation(program, "yPos");
+	glUniform1f(uniformLocation, yPos);
+
+	uniformLocation = glGetUniformLocation(program, "zPos");
+	glUniform1f(uniformLocation, zPos);
+
+	uniformLocation = glGetUniformLocation(program, "xRot");
+	glUniform1f(uniformLocation, lookUp);
+
+	uniformLocation = glGetUniformLocation(program, "yRot");
+	glUniform1f(uniformLocation, lookRight);
+
+	uniformLocation = glGetUniformLocation(program, "resolution");
+	glUniform2f(uniformLocation, float(traceWidth), float(traceHeight));
+
+	uniformLocation = glGetUniformLocation(program, "sphereQuads");
+	glUniform1i(uniformLocation, 0);
+	glDrawArrays(GL_TRIANGLES, 0, gbufferTriangleVertices);
+	glUniform1i(uniformLocation, 1);
+	glDrawArrays(GL_TRIANGLES, gbufferTriangleVertices, gbufferSphereVertices);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindVertexArray(vao[VAO::LINES]);
+	glUseProgram(shader[SHADER::LINE]);
+
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, fboTex[FBO::GBUFFER]);
+	glActiveTexture(GL_TEXTURE0);
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "gbuffer");
+	glUniform1i(uniformLocation, 4);
+}
+
+// --------------------------------------------------------------------------
+// Tile binning
+//
+// A primary ray can only hit the primitives that project onto its pixel, so
+// with L on the bounds of every triangle and sphere are projected with the
+// tracer's camera whenever the view changes, and each TILE_SIZE x TILE_SIZE
+// pixel tile gets the list of primitives that may cover it. Primary rays then
+// search their tile's list (and the planes, which are unbounded) instead of
+// every triangle and sphere. Pressing L again shows the list lengths.
+
+const int TILE_SIZE = 16;		//Same as in trace.glsl
+const float BIN_NEAR = 1e-4f;		//Bounds are clipped just in front of the camera
+
+struct BinStats{
+	int tilesX;
+	int tilesY;
+	size_t entries;
+	size_t longest;
+	double ms;
+};
+BinStats binStats = {0, 0, 0, 0, 0.0};		//Of the last binPrimitives()
+
+//The lists only serve the pixel's own rays, not the lens of DoF
+bool binning()
+{
+	return tileBinning > 0 && !depthOfField();
+}
+
+//Part of a camera space polygon in front of the camera, clipped against the
+//plane z = -BIN_NEAR (Sutherland-Hodgman with a single plane)
+vector<vec3> clipNear(const vector<vec3> &polygon)
+{
+	vector<vec3> clipped;
+	for (size_t i = 0; i < polygon.size(); i++){
+		vec3 a = polygon[i];
+		vec3 b = polygon[(i + 1) % polygon.size()];
+		bool aIn = a.z <= -BIN_NEAR;
+		bool bIn = b.z <= -BIN_NEAR;
+		if (aIn)
+			clipped.push_back(a);
+		if (aIn != bIn)
+			clipped.push_back(mix(a, b, (-BIN_NEAR - a.z)/(b.z - a.z)));
+	}
+	return clipped;
+}
+
+//Tiles (x0, y0, x1, y1 inclusive) the projection of camera space points in front
+//of the camera can touch. The convex hull of the points projects onto the hull of
+//their projections, and the bounds are padded by a pixel for the jittered rays
+ivec4 tileBounds(const vector<vec3> &points, int tilesX, int tilesY)
+{
+	float aspect = float(traceWidth)/traceHeight;
+	vec2 low(1e30f), high(-1e30f);
+	for (const vec3 &point : points){
+		vec2 pixelPos = projectPoint(point);
+		pixelPos.x /= aspect;
+		vec2 pixel = (pixelPos*0.5f + 0.5f)*vec2(traceWidth, traceHeight);
+		low = min(low, pixel);
+		high = max(high, pixel);
+	}
+	//clamped as floats first, points close to the camera plane project far out
+	low = clamp(low - 1.f, vec2(0.f), vec2(traceWidth - 1, traceHeight - 1));
+	high = clamp(high + 1.f, vec2(0.f), vec2(traceWidth - 1, traceHeight - 1));
+	ivec4 tiles(ivec2(low)/TILE_SIZE, ivec2(high)/TILE_SIZE);
+	return ivec4(tiles.x, tiles.y, std::min(tiles.z, tilesX - 1), std::min(tiles.w, tilesY - 1));
+}
+
+//Builds the tile lists for the current view and binds them to texture units 5
+//and 6 for the tracer. Ids are objType*1024 + index, triangles first, so a list
+//is searched in the order of the tracer's own loops
+void binPrimitives()
+{
+	auto start = chrono::steady_clock::now();
+	Camera camera = {vec3(xPos, yPos, zPos), lookUp, lookRight};
+	mat3 rotation = cameraRotation(camera);
+	int tilesX = (traceWidth + TILE_SIZE - 1)/TILE_SIZE;
+	int tilesY = (traceHeight + TILE_SIZE - 1)/TILE_SIZE;
+	vector<vector<GLint>> bins(tilesX*tilesY);
+
+	auto bin = [&](const vector<vec3> &points, GLint id){
+		if (points.empty())
+			return;		//Behind the camera
+		ivec4 tiles = tileBounds(points, tilesX, tilesY);
+		for (int y = tiles.y; y <= tiles.w; y++){
+			for (int x = tiles.x; x <= tiles.z; x++)
+				bins[y*tilesX + x].push_back(id);
+		}
+	};
+	size_t triangles = std::min<size_t>(triangleVecs.size()/5, 50);
+	for (size_t i = 0; i < triangles; i++){
+		vector<vec3> corners;
+		for (int corner = 0; corner < 3; corner++)
+			corners.push_back(rotation*(triangleVecs[i*5 + corner] - camera.pos));
+		bin(clipNear(corners), GLint(i));
+	}
+	size_t spheres = std::min<size_t>(sphereVecs.size()/4, 10);
+	for (size_t i = 0; i < spheres; i++){
+		//the camera aligned box around the sphere, cut off at the clipping plane
+		vec3 centre = rotation*(sphereVecs[i*4] - camera.pos);
+		float radius = sphereVecs[i*4 + 1].x;
+		vector<vec3> box;
+		float nearZ = std::min(centre.z + radius, -BIN_NEAR);
+		if (centre.z - radius <= nearZ){
+			for (int corner = 0; corner < 8; corner++){
+				box.push_back(vec3(centre.x + ((corner & 1) ? radius : -radius),
+				                   centre.y + ((corner & 2) ? radius : -radius),
+				                   (corner & 4) ? nearZ : centre.z - radius));
+			}
+		}
+		bin(box, GLint(1024 + i));
+	}
+
+	vector<GLint> ranges;
+	vector<GLint> lists;
+	binStats.longest = 0;
+	for (const vector<GLint> &list : bins){
+		ranges.push_back(GLint(lists.size()));
+		ranges.push_back(GLint(list.size()));
+		lists.insert(lists.end(), list.begin(), list.end());
+		binStats.longest = std::max(binStats.longest, list.size());
+	}
+	binStats.entries = lists.size();
+	if (lists.empty())
+		lists.push_back(0);		//Buffer textures need storage
+	binStats.tilesX = tilesX;
+	binStats.tilesY = tilesY;
+
+	if (!tileTex[0]){
+		glGenTextures(2, tileTex);
+		glGenBuffers(1, &tileBuffer);
+	}
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, tileTex[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32I, tilesX, tilesY, 0, GL_RG_INTEGER, GL_INT, &ranges[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindBuffer(GL_TEXTURE_BUFFER, tileBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(GLint)*lists.size(), &lists[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_BUFFER, tileTex[1]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, tileBuffer);
+	glActiveTexture(GL_TEXTURE0);
+
+	GLint uniformLocation;
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "tileRanges");
+	glUniform1i(uniformLocation, 5);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "tilePrimitives");
+	glUniform1i(uniformLocation, 6);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "showTileLists");
+	glUniform1i(uniformLocation, tileBinning == 2);
+	binStats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void printBinStats()
+{
+	cout << "Tile binning: " << binStats.tilesX << "x" << binStats.tilesY << " tiles of " << TILE_SIZE << " px, "
+	     << float(binStats.entries)/(binStats.tilesX*binStats.tilesY) << " primitives per tile on average, "
+	     << binStats.longest << " at most, binned in " << binStats.ms << " ms" << endl;
+}
+
+// --------------------------------------------------------------------------
+// Many lights
+//
+// A scene with more than one light is traced with the MANY_LIGHTS path of
+// trace.glsl: its lights go into a tree (lighttree.h) uploaded as two buffer
+// textures, and each shading point traces lightSamples shadow rays to lights
+// picked from the tree by their estimated contribution, instead of one to
+// every light. The result is noisy but unbiased, and T averages it away while
+// the view stands still. --lights <count> swaps the scene's lights for random
+// ones to try this on the stock scenes.
+
+//Box around the scene's triangles and spheres, the planes are unbounded
+void sceneBounds(vec3 &low, vec3 &high)
+{
+	low = vec3(1e30f);
+	high = vec3(-1e30f);
+	for (size_t i = 0; i + 4 < triangleVecs.size(); i += 5){
+		for (int corner = 0; corner < 3; corner++){
+			low = min(low, triangleVecs[i + corner]);
+			high = max(high, triangleVecs[i + corner]);
+		}
+	}
+	for (size_t i = 0; i + 3 < sphereVecs.size(); i += 4){
+		low = min(low, sphereVecs[i] - sphereVecs[i + 1].x);
+		high = max(high, sphereVecs[i] + sphereVecs[i + 1].x);
+	}
+	if (low.x > high.x){
+		low = vec3(-1.f);
+		high = vec3(1.f);
+	}
+}
+
+//Swaps the parsed lights for count random ones around the scene. Their total
+//colour grows with the square of the scene's size, as the lights fall off
+void replaceLights(int count)
+{
+	vec3 low, high;
+	sceneBounds(low, high);
+	vec3 margin = 0.25f*(high - low);
+	float radius = 0.5f*length(high - low);
+	lightVecs.clear();
+	for (const Light &light : randomLights(count, low - margin, high + margin, 0.5f*radius*radius, 1)){
+		lightVecs.push_back(light.pos);
+		lightVecs.push_back(light.color);
+	}
+}
+
+//Builds the tree over the parsed lights and binds it to texture units 7 and 8
+void loadLightTree()
+{
+	if (!manyLights())
+		return;
+	auto start = chrono::steady_clock::now();
+	vector<Light> lights;
+	for (size_t i = 0; i + 1 < lightVecs.size(); i += 2){
+		Light light = {lightVecs[i], lightVecs[i + 1]};
+		lights.push_back(light);
+	}
+	LightTree tree = buildLightTree(lights);
+
+	if (!lightTex[0]){
+		glGenTextures(2, lightTex);
+		glGenBuffers(2, lightBuffer);
+	}
+	const vector<vec4> *data[2] = {&tree.nodes, &tree.lights};
+	for (int i = 0; i < 2; i++){
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4)*data[i]->size(), &(*data[i])[0], GL_STATIC_DRAW);
+		glActiveTexture(GL_TEXTURE7 + i);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTex[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	cout << "Light tree: " << lights.size() << " lights, " << tree.depth << " levels, built in "
+	     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+}
+
+// --------------------------------------------------------------------------
+// Area lights
+//
+// With NUM_AREA_LIGHTS above 0 trace.glsl shades with areaLights[]: every
+// light gets areaSamples shadow rays, one per cell of a grid over it, placed
+// by a blue-noise mask that is shifted every frame. The masks are made once,
+// the first time a scene with area lights is loaded, and bound to unit 9.
+
+const int BLUE_NOISE_SIZE = 64;
+
+void loadBlueNoise()
+{
+	if (blueNoiseTex || numAreaLights() == 0)
+		return;
+	auto start = chrono::steady_clock::now();
+	vector<unsigned char> texels = blueNoise(BLUE_NOISE_SIZE, 4, 1);
+	glGenTextures(1, &blueNoiseTex);
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, blueNoiseTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glActiveTexture(GL_TEXTURE0);
+	cout << "Blue noise: " << BLUE_NOISE_SIZE << "x" << BLUE_NOISE_SIZE << " masks made in "
+	     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+}
+
+//Area lights and then the point lights as lights of size zero
+vector<vec3> areaLightList()
+{
+	vector<vec3> list = areaLightVecs;
+	for (size_t i = 0; i + 1 < lightVecs.size(); i += 2){
+		list.push_back(lightVecs[i]);
+		list.push_back(vec3(0.f));
+		list.push_back(vec3(0.f));
+		list.push_back(lightVecs[i + 1]);
+	}
+	list.resize(4*numAreaLights());
+	return list;
+}
+
+// --------------------------------------------------------------------------
+// Adaptive anti-aliasing
+//
+// Once a complete one sample per pixel image is in the trace target, a second
+// pass estimates the luminance deviation around each pixel and only spends extra
+// samples (4 or 16) where it is above aaThreshold.
+
+bool adaptiveAA = false;
+bool aaValid = false;		//Set when the AA target holds the anti-aliased trace target
+float aaThreshold = 0.05f;
+
+void antialias()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[FBO::AA]);
+	glViewport(0, 0, traceWidth, traceHeight);
+	loadPassUniforms(traceWidth, traceHeight, 1, ivec2(0, 0));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fboTex[FBO::TRACE]);
+
+	GLint uniformLocation;
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "firstPass");
+	glUniform1i(uniformLocation, 0);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "aaThreshold");
+	glUniform1f(uniformLocation, aaThreshold);
+
+	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "adaptivePass");
+	glUniform1i(uniformLocation, 1);
+
+	if (computeTracer)
+		dispatchTrace(FBO::AA, traceWidth, traceHeight);
+	else
+		glDrawArrays(GL_TRIANGLES, 0, points.size());
+
+	glUniform1i(uniformLocation, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// --------------------------------------------------------------------------
+// Ray counters
+//
+// The counting variant of the tracer (ENABLE_COUNTERS) writes per pixel counts
+// to two RGBA32UI targets next to the colour: intersection tests per primitive
+// type and shadow rays, then reflection bounces, rays that left the scene and
+// primary rays. They are read back after the full density trace and the AA pass
+// and summed. Progressive passes are not counted.
+
+struct RayCounts{
+	unsigned long long tests[3];		//Triangle, sphere and plane intersection tests
+	unsigned long long shadowRays;
+	unsigned long long reflections;
+	unsigned long long escaped;		//Rays that missed everything, ending early
+	unsigned long long primary;
+	unsigned long long reprojected;		//Primary hits coloured from the previous frame
+	unsigned maxTests;		//Most intersection tests done for one pixel
+};
+
+vector<unsigned> heatmap;		//Intersection tests per pixel for the last counted frame
+int heatmapWidth = 0;
+int heatmapHeight = 0;
+
+//Creates the counter targets and adds them as draw buffers 1 and 2 of the
+//trace and AA framebuffers
+void initCounterTargets()
+{
+	glDeleteTextures(2, counterTex);
+	glGenTextures(2, counterTex);
+	for (int i = 0; i < 2; i++){
+		glBindTexture(GL_TEXTURE_2D, counterTex[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, fbWidth, fbHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	const int targets[2] = {FBO::TRACE, FBO::AA};
+	for (int target : targets){
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[target]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, counterTex[0], 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, counterTex[1], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "ERROR: counter framebuffer " << target << " is incomplete" << endl;
+	}
+	setDrawBuffers();
+	CheckGLErrors("initCounterTargets");
+}
+
+void deleteCounterTargets()
+{
+	const int targets[2] = {FBO::TRACE, FBO::AA};
+	for (int target : targets){
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[target]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, 0, 0);
+	}
+	setDrawBuffers();
+	glDeleteTextures(2, counterTex);
+	counterTex[0] = counterTex[1] = 0;
+}
+
+//Zeroes the counters of the given target, pixels a pass doesn't cover keep 0
+void clearCounters(int target)
+{
+	const GLuint zero[4] = {0, 0, 0, 0};
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[target]);
+	glClearBufferuiv(GL_COLOR, 1, zero);
+	glClearBufferuiv(GL_COLOR, 2, zero);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//Sums the counters of the last pass into the given target. The first pass of
+//a frame starts a new heatmap, later ones add to it
+RayCounts readCounters(int target, bool newFrame)
+{
+	vector<GLuint> counts0(traceWidth*traceHeight*4);
+	vector<GLuint> counts1(counts0.size());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[target]);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(0, 0, traceWidth, traceHeight, GL_RGBA_INTEGER, GL_UNSIGNED_INT, &counts0[0]);
+	glReadBuffer(GL_COLOR_ATTACHMENT2);
+	glReadPixels(0, 0, traceWidth, traceHeight, GL_RGBA_INTEGER, GL_UNSIGNED_INT, &counts1[0]);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	if (newFrame || heatmapWidth != traceWidth || heatmapHeight != traceHeight){
+		heatmap.assign(traceWidth*traceHeight, 0);
+		heatmapWidth = traceWidth;
+		heatmapHeight = traceHeight;
+	}
+
+	RayCounts total = {};
+	for (int i = 0; i < traceWidth*traceHeight; i++){
+		const GLuint *c0 = &counts0[i*4];
+		const GLuint *c1 = &counts1[i*4];
+		total.tests[0] += c0[0];
+		total.tests[1] += c0[1];
+		total.tests[2] += c0[2];
+		total.shadowRays += c0[3];
+		total.reflections += c1[0];
+		total.escaped += c1[1];
+		total.primary += c1[2];
+		total.reprojected += c1[3];
+		unsigned tests = c0[0] + c0[1] + c0[2];
+		total.maxTests = std::max(total.maxTests, tests);
+		heatmap[i] += tests;
+	}
+	return total;
+}
+
+void printCounts(const char *pass, const RayCounts &counts)
+{
+	unsigned long long tests = counts.tests[0] + counts.tests[1] + counts.tests[2];
+	double pixels = double(traceWidth)*traceHeight;
+	cout << pass << ": " << counts.primary << " primary rays, " << counts.shadowRays << " shadow rays, "
+	     << counts.reflections << " reflection bounces, " << counts.escaped << " rays left the scene";
+	if (counts.reprojected > 0)
+		cout << ", " << counts.reprojected << " hits reprojected";
+	cout << endl;
+	cout << "  " << tests << " intersection tests (triangle " << counts.tests[0] << ", sphere " << counts.tests[1]
+	     << ", plane " << counts.tests[2] << "), " << tests/pixels << " per pixel, at most " << counts.maxTests << endl;
+}
+
+//Writes the last counted frame's intersection tests per pixel as a black-red-yellow-white image
+bool writeHeatmap(const string &filename)
+{
+	if (heatmap.empty())
+		return false;
+	unsigned most = std::max(1u, *max_element(heatmap.begin(), heatmap.end()));
+	vector<unsigned char> rgb(heatmap.size()*3);
+	for (int y = 0; y < heatmapHeight; y++){
+		for (int x = 0; x < heatmapWidth; x++){
+			float t = float(heatmap[y*heatmapWidth + x])/most;
+			unsigned char *pixel = &rgb[((heatmapHeight - 1 - y)*heatmapWidth + x)*3];
+			pixel[0] = (unsigned char)(255.f*clamp(3.f*t, 0.f, 1.f));
+			pixel[1] = (unsigned char)(255.f*clamp(3.f*t - 1.f, 0.f, 1.f));
+			pixel[2] = (unsigned char)(255.f*clamp(3.f*t - 2.f, 0.f, 1.f));
+		}
+	}
+	if (!stbi_write_png(filename.c_str(), heatmapWidth, heatmapHeight, 3, &rgb[0], heatmapWidth*3)){
+		cout << "ERROR: could not write " << filename << endl;
+		return false;
+	}
+	cout << "Wrote " << filename << " (white = " << most << " intersection tests)" << endl;
+	return true;
+}
+
+//Copies the given target to the window, filtering it up to the window size
+//when it was traced at a reduced resolution
+void present(int target)
+{
+	bool scaled = (traceWidth != fbWidth || traceHeight != fbHeight);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[target]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glViewport(0, 0, fbWidth, fbHeight);
+	glBlitFramebuffer(0, 0, traceWidth, traceHeight, 0, 0, fbWidth, fbHeight, GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// --------------------------------------------------------------------------
+// Dynamic resolution
+//
+// While the view is changing the tracer only fills the lower left renderScale
+// of the targets in each direction and present() stretches that over the window.
+// The scale follows the GPU time of the trace passes, taken from the frame
+// statistics below, towards frameBudget. Software renderers such as
+// llvmpipe defer rasterization past the end of the query and report far too
+// little, so the time between consecutive moving frames is used when it is
+// larger. When the camera stops the view is traced once more at full resolution.
+
+bool dynamicResolution = false;
+float frameBudget = 33.f;		//Milliseconds of GPU time per frame while moving
+float renderScale = 1.f;		//Scale the current image was traced at
+float movingScale = 1.f;		//Scale the controller picked for frames in motion
+const float MIN_RENDER_SCALE = 0.25f;
+
+chrono::steady_clock::time_point lastMovingFrame;
+bool movingLastFrame = false;		//lastMovingFrame is the frame right before this one
+double frameInterval = 0.0;		//Milliseconds between the last two moving frames
+
+void setRenderScale(float scale)
+{
+	renderScale = scale;
+	traceWidth = std::max(1, int(fbWidth*scale + 0.5f));
+	traceHeight = std::max(1, int(fbHeight*scale + 0.5f));
+}
+
+//Trace cost grows with the pixel count, the square of the scale. The timing
+//is a frame or two old, so it is applied to the scale it was measured at, and
+//steps are limited so a single slow frame can't make the resolution jump around
+void updateRenderScale(double milliseconds, float measuredScale)
+{
+	float scale = measuredScale*float(sqrt(frameBudget/std::max(milliseconds, 0.01)));
+	scale = clamp(scale, movingScale*0.8f, movingScale*1.25f);
+	scale = clamp(scale, MIN_RENDER_SCALE, 1.f);
+	if (fabs(scale - movingScale) > 0.02f || scale == 1.f)
+		movingScale = scale;
+}
+
+// --------------------------------------------------------------------------
+// Frame statistics
+//
+// Every pass render() issues is wrapped in a GL_TIME_ELAPSED query. Frames
+// alternate between two sets of queries and a frame's results are collected
+// when its set comes round again, two frames later, so the GPU has normally
+// finished with them. The CPU side times the uniform upload, issuing the passes
+// and the buffer swap. H prints rolling percentiles once a second (and puts them
+// in the window title), --stats <file> writes one CSV row per frame.
+
+struct FrameStats{
+	int frame;
+	bool moving;		//Traced at the dynamic resolution scale
+	float scale;
+	double interval;		//Milliseconds since the previous moving frame, 0 if there was none
+	double upload;		//CPU milliseconds in loadUniforms
+	double issue;		//CPU milliseconds for render() to issue every pass
+	double swap;		//CPU milliseconds in glfwSwapBuffers
+	bool ran[PASS::COUNT];
+	double gpu[PASS::COUNT];		//GPU milliseconds per pass
+};
+
+const char *PASS_NAMES[PASS::COUNT] = {"gbuffer", "trace", "refine", "aa", "accum", "present"};
+const unsigned STATS_WINDOW = 120;		//Frames the HUD percentiles cover
+
+FrameStats frameStats[2];		//Frames whose queries may still be in flight
+bool frameStatsPending[2] = {false, false};
+int statsSlot = 0;
+int frameCount = 0;
+deque<FrameStats> statsHistory;
+bool showHud = false;
+chrono::steady_clock::time_point lastHudPrint;
+ofstream statsFile;
+
+void beginPass(int pass)
+{
+	glBeginQuery(GL_TIME_ELAPSED, passQuery[statsSlot][pass]);
+	frameStats[statsSlot].ran[pass] = true;
+}
+
+void endPass()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+double gpuTotal(const FrameStats &stats)
+{
+	double total = 0.0;
+	for (int i = 0; i < PASS::COUNT; i++)
+		total += stats.gpu[i];
+	return total;
+}
+
+double percentile(vector<double> values, double fraction)
+{
+	if (values.empty())
+		return 0.0;
+	size_t index = size_t(fraction*(values.size() - 1) + 0.5);
+	nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+void printHud()
+{
+	vector<double> gpu, trace, cpu, swap;
+	for (const FrameStats &stats : statsHistory){
+		gpu.push_back(gpuTotal(stats));
+		trace.push_back(stats.gpu[PASS::TRACE]);
+		cpu.push_back(stats.upload + stats.issue);
+		swap.push_back(stats.swap);
+	}
+	char line[256];
+	snprintf(line, sizeof(line), "gpu %.1f/%.1f/%.1f  trace %.1f/%.1f/%.1f  cpu %.2f/%.2f/%.2f  swap %.1f/%.1f/%.1f ms (p50/p95/p99, %d frames) scale %.2f",
+		percentile(gpu, 0.5), percentile(gpu, 0.95), percentile(gpu, 0.99),
+		percentile(trace, 0.5), percentile(trace, 0.95), percentile(trace, 0.99),
+		percentile(cpu, 0.5), percentile(cpu, 0.95), percentile(cpu, 0.99),
+		percentile(swap, 0.5), percentile(swap, 0.95), percentile(swap, 0.99),
+		int(statsHistory.size()), renderScale);
+	cout << line << endl;
+	if (window)
+		glfwSetWindowTitle(window, line);
+}
+
+bool openStatsFile(const string &filename)
+{
+	statsFile.open(filename.c_str());
+	if (!statsFile){
+		cout << "ERROR: could not open " << filename << endl;
+		return false;
+	}
+	statsFile << "frame,moving,scale,interval_ms,upload_ms,issue_ms,swap_ms";
+	for (int i = 0; i < PASS::COUNT; i++)
+		statsFile << ",gpu_" << PASS_NAMES[i] << "_ms";
+	statsFile << ",gpu_total_ms" << endl;
+	return true;
+}
+
+//Collects the GPU times of the frame that last used this slot and hands the
+//finished frame to the dynamic resolution controller, the log and the HUD
+void resolveFrameStats(int slot)
+{
+	if (!frameStatsPending[slot])
+		return;
+	frameStatsPending[slot] = false;
+	FrameStats &stats = frameStats[slot];
+	for (int i = 0; i < PASS::COUNT; i++){
+		GLuint64 nanoseconds = 0;
+		if (stats.ran[i])
+			glGetQueryObjectui64v(passQuery[slot][i], GL_QUERY_RESULT, &nanoseconds);
+		stats.gpu[i] = nanoseconds*1e-6;
+	}
+
+	if (stats.moving){
+		double traceTime = stats.gpu[PASS::GBUFFER] + stats.gpu[PASS::TRACE] + stats.gpu[PASS::REFINE] + stats.gpu[PASS::AA] + stats.gpu[PASS::ACCUM];
+		updateRenderScale(std::max(traceTime, stats.interval), stats.scale);
+	}
+
+	if (statsFile.is_open()){
+		statsFile << stats.frame << "," << stats.moving << "," << stats.scale << "," << stats.interval << ","
+		          << stats.upload << "," << stats.issue << "," << stats.swap;
+		for (int i = 0; i < PASS::COUNT; i++)
+			statsFile << "," << stats.gpu[i];
+		statsFile << "," << gpuTotal(stats) << "\n";
+	}
 
-	uniformLocation = glGetUniformLocation(shader[SHADER::LINE], "scene3");
-	glUniform1f(uniformLocation, scene3);
+	statsHistory.push_back(stats);
+	if (statsHistory.size() > STATS_WINDOW)
+		statsHistory.pop_front();
+	auto now = chrono::steady_clock::now();
+	if (showHud && now - lastHudPrint >= chrono::seconds(1)){
+		printHud();
+		lastHudPrint = now;
+	}
+}
 
-	return !CheckGLErrors("loadUniforms");
+//Called after glfwSwapBuffers with the time it took, for the frame just rendered
+void recordSwap(double milliseconds)
+{
+	frameStats[1 - statsSlot].swap = milliseconds;
+}
+
+//Waits for the frames still in flight so the log has every frame
+void finishFrameStats()
+{
+	resolveFrameStats(statsSlot);
+	resolveFrameStats(1 - statsSlot);
+	if (statsFile.is_open())
+		statsFile.close();
 }
 
 //Draws buffers to screen
 void render()
 {
-	glClearColor(0.f, 0.f, 0.f, 0.f);		//Color to clear the screen with (R, G, B, Alpha)
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);		//Clear color and depth buffers (Haven't covered yet)
-
 	//Don't need to call these on every draw, so long as they don't change
 	glUseProgram(shader[SHADER::LINE]);		//Use LINE program
 	glBindVertexArray(vao[VAO::LINES]);		//Use the LINES vertex array
 
-	loadUniforms();
-
-	glDrawArrays(
-			GL_TRIANGLES,		//What shape we're drawing	- GL_TRIANGLES, GL_LINES, GL_POINTS, GL_QUADS, GL_TRIANGLE_STRIP
-			0,					//Starting index
-			points.size()		//How many vertices
-			);
+	int slot = statsSlot;
+	resolveFrameStats(slot);
+	FrameStats &stats = frameStats[slot];
+	stats = FrameStats();
+	stats.frame = frameCount++;
 
-	CheckGLErrors("render");
-}
+	auto start = chrono::steady_clock::now();
+	loadUniforms();
+	stats.upload = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-string readFile(string filename){
-	ifstream myFile;
-	
-	myFile.open(filename);
-	
-	myFile.seekg(0, myFile.end);
-	int length = (myFile.tellg());
-	myFile.seekg(0,myFile.beg);
-
-	char *buffer = new char[length];
-	myFile.read(buffer,length);
-	myFile.close();
-
-	string retString(buffer);
-	return retString;
-}
-
-//Taken from: http://ysonggit.github.io/coding/2014/12/16/split-a-string-using-c.html
-void split(const string &s, const char* delim, vector<string> & v){
-    char * dup = strdup(s.c_str());
-    char * token = strtok(dup, delim);
-    while(token != NULL){
-        v.push_back(string(token));
-        token = strtok(NULL, delim);
-    }
-    free(dup);
-}
-
-void parse(string line, int id){
-	vector<string> coords;
-	split(line, " ", coords);
-	GLfloat x = stof(coords[0]);
-	GLfloat y = stof(coords[1]);
-	GLfloat z = stof(coords[2]);
-
-	switch (id) {
-		case 0 :
-			triangleVecs.push_back(vec3(x,y,z));
-			break;
-		case 1 :
-			sphereVecs.push_back(vec3(x,y,z));
-			break;
-		case 2 :
-			planeVecs.push_back(vec3(x,y,z));
-			break;
-		case 3 :
-			lightVecs.push_back(vec3(x,y,z));
-			break;
-	}
-}
-
-void parseObjects(string textData){
-	vector<string> lines;
-	split(textData,  "\n", lines);
-	for (unsigned i = 0; i < lines.size(); i++){
-		char id = lines[i][0];
-		if (id == 't'){
-			parse(lines[i+1], 0);
-			parse(lines[i+2], 0);
-			parse(lines[i+3], 0);
-			parse(lines[i+4], 0);
-			parse(lines[i+5], 0);
-			i+=5;
-		}
-		else if (id == 's'){
-			parse(lines[i+1], 1);
-			parse(lines[i+2], 1);
-			parse(lines[i+3], 1);
-			parse(lines[i+4], 1);
-			i+=4;
+	bool moving = dynamicResolution && viewChanged;
+	if (moving){
+		auto now = chrono::steady_clock::now();
+		frameInterval = movingLastFrame ? chrono::duration<double, milli>(now - lastMovingFrame).count() : 0.0;
+		lastMovingFrame = now;
+	}
+	movingLastFrame = moving;
+	if (dynamicResolution){
+		if (viewChanged){
+			setRenderScale(movingScale);
 		}
-		else if (id == 'p'){
-			parse(lines[i+1], 2);
-			parse(lines[i+2], 2);
-			parse(lines[i+3], 2);
-			parse(lines[i+4], 2);
-			i+=4;
+		else if (renderScale < 1.f){
+			setRenderScale(1.f);		//The camera stopped, trace the final image at full resolution
+			viewChanged = true;
 		}
-		else if (id == 'l'){
-			parse(lines[i+1], 3);
-			parse(lines[i+2], 3);
-			i+=2;
+	}
+	//the camera stopped on reused colours, shade the whole view once more
+	if (reprojectedImage && !viewChanged && progressiveStride <= 1)
+		viewChanged = true;
+	if (viewChanged)
+		accumFrames = 0;
+	loadFrameUniforms();
+	if (rasterizing() && viewChanged){
+		beginPass(PASS::GBUFFER);
+		rasterizeGBuffer();
+		endPass();
+	}
+	if (binning() && viewChanged)
+		binPrimitives();
+	//only frames traced in motion steer the controller
+	stats.moving = moving;
+	stats.scale = renderScale;
+	stats.interval = moving ? frameInterval : 0.0;
+
+	int blockSize = progressiveStride*progressiveStride;
+	bool traced = true;
+	if (progressiveStride <= 1){
+		if (viewChanged){
+			if (countersEnabled)
+				clearCounters(FBO::TRACE);
+			beginPass(PASS::TRACE);
+			if (reprojection)
+				traceReprojected();
+			else
+				traceFull();
+			endPass();
+			if (countersEnabled)
+				printCounts("trace", readCounters(FBO::TRACE, true));
 		}
-		else{
-			//do nothing
+		else
+			traced = false;		//The trace target still holds this view
+	}
+	else if (viewChanged){
+		dropHistory();
+		beginPass(PASS::TRACE);
+		traceLowRes(progressiveStride, ivec2(0, 0));
+		endPass();
+		beginPass(PASS::REFINE);
+		stretchLowRes(progressiveStride);
+		endPass();
+		refinePass = 1;
+	}
+	else if (refinePass < blockSize){
+		ivec2 offset = refineOffset(refinePass, progressiveStride);
+		dropHistory();
+		beginPass(PASS::TRACE);
+		traceLowRes(progressiveStride, offset);
+		endPass();
+		beginPass(PASS::REFINE);
+		scatterLowRes(progressiveStride, offset);
+		endPass();
+		refinePass++;
+	}
+	else
+		traced = false;
+	viewChanged = false;
+
+	if (traced)
+		aaValid = false;
+	bool complete = (progressiveStride <= 1) || (refinePass >= blockSize);
+	//the average is anti-aliased by its pixel jitter, it replaces the AA pass
+	bool averaging = accumulating();
+	if (averaging && complete && accumFrames < MAX_ACCUM_FRAMES){
+		if (!traced){
+			dropHistory();
+			beginPass(PASS::TRACE);
+			traceFull();
+			endPass();
 		}
+		beginPass(PASS::ACCUM);
+		accumulate();
+		endPass();
+	}
+	else if (!averaging && adaptiveAA && complete && !aaValid){
+		if (countersEnabled)
+			clearCounters(FBO::AA);
+		beginPass(PASS::AA);
+		antialias();
+		endPass();
+		if (countersEnabled && progressiveStride <= 1)
+			printCounts("aa", readCounters(FBO::AA, false));
+		aaValid = true;
 	}
+
+	beginPass(PASS::PRESENT);
+	if (averaging && accumFrames > 0)
+		present(accumTarget);
+	else
+		present((adaptiveAA && aaValid) ? FBO::AA : FBO::TRACE);
+	endPass();
+
+	stats.issue = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() - stats.upload;
+	frameStatsPending[slot] = true;
+	statsSlot = 1 - slot;
+
+	CheckGLErrors("render");
+}
+
+//True while render() still has tracing to do for the current view
+bool renderPending()
+{
+	bool complete = (progressiveStride <= 1) || (refinePass >= progressiveStride*progressiveStride);
+	bool averaging = accumulating() ? (accumFrames < MAX_ACCUM_FRAMES) : (adaptiveAA && !aaValid);
+	return viewChanged || !complete || averaging || reprojectedImage || (dynamicResolution && renderScale < 1.f);
 }
 
 bool loadUniformBuffer(){
@@ -363,76 +1849,56 @@ bool loadUniformBuffer(){
 	GLint uniformLocation;
 	vec3 temp;
 	string uniformName;
-	for (unsigned i = 0; i < 200; i++){
+	for (unsigned i = 0; i + 4 < std::min<size_t>(triangleVecs.size(), 250); i += 5){
 		glUseProgram(shader[SHADER::LINE]);
-		string nameBeg = "triangles[";
-		string strCount = to_string(count);
-
-		if (i < triangleVecs.size())
-			temp = triangleVecs[i];
-		else
-			temp = vec3(0,0,0);
-
-		string nameEnd = "].p0"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform1 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform1);
-		glUniform3f(uniformLocation, temp.x, temp.y, temp.z);
-		i++;
-		if (i < triangleVecs.size())
-			temp = triangleVecs[i];
-		else
-			temp = vec3(0,0,0);
-
-		nameEnd = "].p1"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform2 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform2);
-		glUniform3f(uniformLocation, temp.x, temp.y, temp.z);
-		i++;
-		if (i < triangleVecs.size())
-			temp = triangleVecs[i];
-		else
-			temp = vec3(0,0,0);
-
-		nameEnd = "].p2"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform3 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform3);
+		string nameBeg = "triangles[" + to_string(count);
+
+		//Per-triangle data the intersection test used to rebuild for every ray:
+		//edges from p0 and the unit normal used for shading
+		vec3 p0 = triangleVecs[i];
+		vec3 e1 = triangleVecs[i+1] - p0;
+		vec3 e2 = triangleVecs[i+2] - p0;
+		vec3 n = cross(e1, e2);
+		vec3 normal = (length(n) > 0.f) ? normalize(n) : vec3(0,0,0);
+
+		uniformName = nameBeg + "].p0";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform3f(uniformLocation, p0.x, p0.y, p0.z);
+
+		uniformName = nameBeg + "].e1";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform3f(uniformLocation, e1.x, e1.y, e1.z);
+
+		uniformName = nameBeg + "].e2";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform3f(uniformLocation, e2.x, e2.y, e2.z);
+
+		uniformName = nameBeg + "].normal";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform3f(uniformLocation, normal.x, normal.y, normal.z);
+
+		temp = triangleVecs[i+3];
+		uniformName = nameBeg + "].color";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
 		glUniform3f(uniformLocation, temp.x, temp.y, temp.z);
-		i++;
-		if (i < triangleVecs.size())
-			temp = triangleVecs[i];
-		else
-			temp = vec3(0,0,0);
 
-		nameEnd = "].color"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform4 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform4);
-		glUniform3f(uniformLocation, temp.x, temp.y, temp.z);
-		i++;
-		if (i < triangleVecs.size()){
-			temp = triangleVecs[i];
-		}
-		else {
-			temp = vec3(0,0,0);
-		}
-		nameEnd = "].p"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform5 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform5);
+		temp = triangleVecs[i+4];
+		uniformName = nameBeg + "].p";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
 		glUniform1f(uniformLocation, temp.x);
 
-		nameEnd = "].specCol"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform6 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform6);
+		uniformName = nameBeg + "].specCol";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
 		glUniform1f(uniformLocation, temp.y);
 
-		nameEnd = "].ref"; uniformName = nameBeg + strCount + nameEnd;
-		const char * uniform7 = uniformName.c_str();
-		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform7);
+		uniformName = nameBeg + "].ref";
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
 		glUniform1f(uniformLocation, temp.z);
 
 		count++;
 	}
 	count = 0;
-	for (unsigned i = 0; i < 40; i++){
+	for (unsigned i = 0; i < std::min<size_t>(sphereVecs.size(), 40); i++){
 		glUseProgram(shader[SHADER::LINE]);
 		string nameBeg = "spheres[";
 		string strCount = to_string(count);
@@ -446,6 +1912,7 @@ bool loadUniformBuffer(){
 		const char * uniform1 = uniformName.c_str();
 		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform1);
 		glUniform3f(uniformLocation, temp.x, temp.y, temp.z);
+		vec3 center = temp;
 		i++;
 		if (i < sphereVecs.size())
 			temp = sphereVecs[i];
@@ -456,6 +1923,15 @@ bool loadUniformBuffer(){
 		const char * uniform2 = uniformName.c_str();
 		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniform2);
 		glUniform1f(uniformLocation, temp.x);
+
+		//Squared radius and |center|^2 are constant terms of the quadratic
+		nameEnd = "].radius2"; uniformName = nameBeg + strCount + nameEnd;
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform1f(uniformLocation, temp.x*temp.x);
+
+		nameEnd = "].centerDot"; uniformName = nameBeg + strCount + nameEnd;
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], uniformName.c_str());
+		glUniform1f(uniformLocation, dot(center, center));
 		i++;
 		if (i < sphereVecs.size())
 			temp = sphereVecs[i];
@@ -492,13 +1968,14 @@ bool loadUniformBuffer(){
 		count++;
 	}
 	count = 0;
-	for (unsigned i = 0; i < 8; i++){
+	for (unsigned i = 0; i < std::min<size_t>(planeVecs.size(), 8); i++){
 		glUseProgram(shader[SHADER::LINE]);
 		string nameBeg = "planes[";
 		string strCount = to_string(count);
 
-		if (i < planeVecs.size())
-			temp = planeVecs[i];
+		//Normalized once here instead of at every hit
+		if (i < planeVecs.size() && length(planeVecs[i]) > 0.f)
+			temp = normalize(planeVecs[i]);
 		else
 			temp = vec3(0,0,0);
 
@@ -552,7 +2029,8 @@ bool loadUniformBuffer(){
 		count++;
 	}
 	count = 0;
-	for (unsigned i = 0; i < 4; i++){
+	//lights[] holds one light, scenes with more take the manyLights() or area light path
+	for (unsigned i = 0; i < 2; i++){
 		glUseProgram(shader[SHADER::LINE]);
 		string nameBeg = "lights[";
 		string strCount = to_string(count);
@@ -579,13 +2057,60 @@ bool loadUniformBuffer(){
 
 		count++;
 	}
-	planeVecs.clear();
-    sphereVecs.clear();
-    lightVecs.clear();
-    triangleVecs.clear();
+	vector<vec3> areaLights = areaLightList();
+	for (size_t i = 0; i + 3 < areaLights.size(); i += 4){
+		//Spheres are stored as centre, (radius, 0, 0), zero and colour
+		bool sphere = (areaLights[i + 2] == vec3(0.f));
+		vec3 edge1 = sphere ? vec3(0.f) : areaLights[i + 1];
+		string nameBeg = "areaLights[" + to_string(i/4);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], (nameBeg + "].centre").c_str());
+		glUniform3f(uniformLocation, areaLights[i].x, areaLights[i].y, areaLights[i].z);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], (nameBeg + "].edge1").c_str());
+		glUniform3f(uniformLocation, edge1.x, edge1.y, edge1.z);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], (nameBeg + "].edge2").c_str());
+		glUniform3f(uniformLocation, areaLights[i + 2].x, areaLights[i + 2].y, areaLights[i + 2].z);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], (nameBeg + "].color").c_str());
+		glUniform3f(uniformLocation, areaLights[i + 3].x, areaLights[i + 3].y, areaLights[i + 3].z);
+
+		uniformLocation = glGetUniformLocation(shader[SHADER::LINE], (nameBeg + "].radius").c_str());
+		glUniform1f(uniformLocation, sphere ? areaLights[i + 1].x : 0.f);
+	}
 	return !CheckGLErrors("loadUniformBuffer");
 }
 
+//Parses a scene file, switches to the tracer variant specialized for it and
+//uploads its geometry
+bool loadScene(const string &filename)
+{
+	string textData = readFile(filename);
+	if (textData.empty())
+		return false;
+	planeVecs.clear();
+	sphereVecs.clear();
+	lightVecs.clear();
+	areaLightVecs.clear();
+	triangleVecs.clear();
+	parseObjects(textData);
+	if (generatedLights > 0 && areaLightVecs.empty())
+		replaceLights(generatedLights);
+	size_t sceneLights = areaLightVecs.size()/4 + lightVecs.size()/2;
+	if (!areaLightVecs.empty() && sceneLights > (size_t)MAX_AREA_LIGHTS)
+		cout << "WARNING: " << sceneLights << " lights with area lights in the scene, only the first "
+		     << MAX_AREA_LIGHTS << " (area lights first) are traced" << endl;
+	loadLightTree();
+	loadBlueNoise();
+	scene3 = isScene3(filename);
+	dropHistory();
+	loadPrimitiveBuffer();
+	useVariant();
+	loadUniformBuffer();
+	return loadUniforms();
+}
+
 // --------------------------------------------------------------------------
 // GLFW callback functions
 
@@ -613,22 +2138,20 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
     if (key == GLFW_KEY_1 && action == GLFW_PRESS){
-        string textData = readFile("scene1.txt");
-        parseObjects(textData);
-        loadUniformBuffer();
-        scene3 = false;
+        loadScene("scene1.txt");
+        viewChanged = true;
     }
     if (key == GLFW_KEY_2 && action == GLFW_PRESS){
-        string textData = readFile("scene2.txt");
-        parseObjects(textData);
-        loadUniformBuffer();
-        scene3 = false;
+        loadScene("scene2.txt");
+        viewChanged = true;
     }
     if (key == GLFW_KEY_3 && action == GLFW_PRESS){
-        string textData = readFile("scene3.txt");
-        parseObjects(textData);
-        loadUniformBuffer();
-        scene3 = true;
+        loadScene("scene3.txt");
+        viewChanged = true;
+    }
+    if (key == GLFW_KEY_4 && action == GLFW_PRESS){
+        loadScene("scene4.txt");
+        viewChanged = true;
     }
     if (key == GLFW_KEY_W){
     	if(action == GLFW_PRESS){
@@ -704,20 +2227,682 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     	else {
     		focus = false;
     	}
+    	//the thin lens is compiled into its own variant
+    	if (useVariant()){
+    		loadUniformBuffer();
+    		loadUniforms();
+    	}
+    	viewChanged = true;
+    	if (focus)
+    		cout << "Depth of field: aperture " << aperture << ", focus distance " << focusDistance << (scene3 ? " (not in scene 3)" : "") << endl;
+    	else
+    		cout << "Depth of field: off" << endl;
+    }
+    if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action != GLFW_RELEASE && focus){
+    	focusDistance *= (key == GLFW_KEY_RIGHT_BRACKET) ? 1.1f : 1.f/1.1f;
+    	cout << "Focus distance: " << focusDistance << endl;
+    	viewChanged = true;
+    }
+    if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL) && action != GLFW_RELEASE && focus){
+    	aperture = (key == GLFW_KEY_EQUAL) ? std::min(aperture*1.25f + 0.01f, 2.f) : std::max(aperture/1.25f - 0.01f, 0.f);
+    	cout << "Aperture: " << aperture << endl;
+    	viewChanged = true;
+    }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS){
+    	//retraced from the pixel centres either way, DoF always averages
+    	temporalAccumulation = !temporalAccumulation;
+    	viewChanged = true;
+    	cout << "Temporal accumulation: " << (temporalAccumulation ? "on" : "off") << (focus && !temporalAccumulation ? " (still on for DoF)" : "") << endl;
+    }
+    if (key == GLFW_KEY_N && action == GLFW_PRESS){
+    	//1 -> 4 -> 16 shadow rays per area light
+    	areaSamples = (areaSamples >= 16) ? 1 : areaSamples*4;
+    	viewChanged = true;
+    	cout << "Area light samples: " << areaSamples << (numAreaLights() == 0 ? " (no area lights in this scene)" : "") << endl;
+    }
+    if (key == GLFW_KEY_X && action == GLFW_PRESS){
+    	adaptiveAA = !adaptiveAA;
+    	redrawPending = true;
+    	cout << "Adaptive anti-aliasing: " << (adaptiveAA ? "on" : "off") << endl;
+    }
+    if (key == GLFW_KEY_B && action == GLFW_PRESS){
+    	//20 bounces (original) -> 8 -> 4, the budgets also stop below 1% of the energy.
+    	//Roulette (--roulette) is left off here, at one sample per pixel its noise
+    	//costs more than the bounces it saves
+    	maxBounces = (maxBounces > 8) ? 8 : (maxBounces > 4) ? 4 : 20;
+    	minReflCoeff = (maxBounces < 20) ? 0.01f : 0.f;
+    	cout << "Reflections: " << maxBounces << " bounces max";
+    	if (minReflCoeff > 0.f)
+    		cout << ", stop below " << minReflCoeff << " of the energy";
+    	cout << endl;
+    	viewChanged = true;
+    }
+    if (key == GLFW_KEY_C && action == GLFW_PRESS){
+    	//leaving count mode writes the heatmap of the last counted frame
+    	countersEnabled = !countersEnabled;
+    	if (countersEnabled)
+    		initCounterTargets();
+    	else {
+    		writeHeatmap("heatmap.png");
+    		deleteCounterTargets();
+    	}
+    	if (useVariant()){
+    		loadUniformBuffer();
+    		loadUniforms();
+    	}
+    	viewChanged = true;
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS){
+    	if (computeTemplate.empty())
+    		cout << "Compute tracer: needs OpenGL 4.3" << endl;
+    	else {
+    		//fragment -> compute -> compute with the scene in shared memory
+    		if (!computeTracer)
+    			computeTracer = true;
+    		else if (!sharedPrimitives)
+    			sharedPrimitives = true;
+    		else
+    			computeTracer = sharedPrimitives = false;
+    		cout << "Compute tracer: " << (computeTracer ? (sharedPrimitives ? "on, shared memory tiles" : "on") : "off") << endl;
+    		if (useVariant()){
+    			loadUniformBuffer();
+    			loadUniforms();
+    		}
+    		viewChanged = true;
+    	}
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS){
+    	showHud = !showHud;
+    	if (!showHud)
+    		glfwSetWindowTitle(window, WINDOW_TITLE);
+    }
+    if (key == GLFW_KEY_R && action == GLFW_PRESS){
+    	dynamicResolution = !dynamicResolution;
+    	if (!dynamicResolution)
+    		setRenderScale(1.f);
+    	viewChanged = true;
+    	cout << "Dynamic resolution: ";
+    	if (dynamicResolution)
+    		cout << frameBudget << " ms budget" << endl;
+    	else
+    		cout << "off" << endl;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS){
+    	//cycle full density -> 1/4 density -> 1/16 density while moving
+    	progressiveStride = (progressiveStride >= 4) ? 1 : progressiveStride*2;
+    	viewChanged = true;
+    	if (progressiveStride > 1)
+    		cout << "Progressive refinement: 1/" << progressiveStride*progressiveStride << " pixel density while moving" << endl;
+    	else
+    		cout << "Progressive refinement: off" << endl;
+    }
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS){
+    	//primary visibility from the rasterized G-buffer, compiled into its own variant
+    	hybridRendering = !hybridRendering;
+    	if (useVariant()){
+    		loadUniformBuffer();
+    		loadUniforms();
+    	}
+    	viewChanged = true;
+    	cout << "Hybrid rendering: " << (hybridRendering ? "on" : "off") << (hybridRendering && depthOfField() ? " (not with DoF)" : "") << endl;
+    }
+    if (key == GLFW_KEY_L && action == GLFW_PRESS){
+    	//off, binned primary rays, then the list lengths instead of the image
+    	tileBinning = (tileBinning + 1) % 3;
+    	if (useVariant()){
+    		loadUniformBuffer();
+    		loadUniforms();
+    	}
+    	if (binning()){
+    		binPrimitives();
+    		printBinStats();
+    	}
+    	viewChanged = true;
+    	const char *modes[3] = {"off", "on", "showing list lengths"};
+    	cout << "Tile binning: " << modes[tileBinning] << (tileBinning && depthOfField() ? " (not with DoF)" : "") << endl;
     }
+    if (key == GLFW_KEY_V && action == GLFW_PRESS){
+    	reprojection = !reprojection;
+    	if (reprojection)
+    		initReprojectionTargets();
+    	else
+    		deleteReprojectionTargets();
+    	if (useVariant()){
+    		loadUniformBuffer();
+    		loadUniforms();
+    	}
+    	viewChanged = true;
+    	cout << "Temporal reprojection: " << (reprojection ? "on" : "off");
+    	if (reprojection && (progressiveStride > 1 || accumulating()))
+    		cout << " (not while " << (progressiveStride > 1 ? "P" : "averaging") << " is on)";
+    	cout << endl;
+    }
+}
+
+chrono::steady_clock::time_point launchTime;
+
+//Time from launch until the first frame can be traced (context, shaders, scene)
+void reportStartup()
+{
+	cout << "Startup took " << chrono::duration<double, milli>(chrono::steady_clock::now() - launchTime).count() << " ms" << endl;
+}
+
+//Recreates the trace targets at the new framebuffer size
+void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
+{
+	if (width <= 0 || height <= 0)		//Minimized
+		return;
+	glDeleteFramebuffers(FBO::COUNT, fbo);
+	glDeleteTextures(FBO::COUNT, fboTex);
+	glDeleteRenderbuffers(1, &gbufferDepth);
+	fbWidth = width;
+	fbHeight = height;
+	setRenderScale(renderScale);
+	initFramebuffers(fbWidth, fbHeight);
+	if (countersEnabled)
+		initCounterTargets();
+	if (reprojection)
+		initReprojectionTargets();
+	viewChanged = true;
+}
+
+//The window was exposed or damaged and its contents are lost
+void WindowRefreshCallback(GLFWwindow* window)
+{
+	redrawPending = true;
 }
 
-//Initialization
-void initGL()
+//Initialization, the caller loads a scene afterwards with loadScene
+void initGL(int width, int height)
 {
 	generateIDs();
 	initShader();
 	initVAO();
 	generateSquare(2.f);
 	loadBuffer(points, uvs);
-	string textData = readFile("scene1.txt");
-    parseObjects(textData);
-    loadUniformBuffer();
+	fbWidth = width;
+	fbHeight = height;
+	setRenderScale(1.f);
+	initFramebuffers(fbWidth, fbHeight);
+	glGenQueries(2*PASS::COUNT, &passQuery[0][0]);
+}
+
+// ==========================================================================
+// COMMAND LINE MODES
+//
+//   a.out                                  interactive window (default)
+//   a.out --worker <address>               serve distributed render jobs
+//   a.out --coordinator <hosts file>       render on the listed workers
+//   a.out --cpu                            render on this machine's CPU cores
+//   a.out --offscreen                      render with the GLSL tracer without a
+//                                          window (surfaceless EGL) and exit
+//   a.out --sampler-convergence            print the error of random, R2 and
+//                                          Owen-scrambled Sobol points (sampler.h)
+//   a.out --rng-throughput [--threads n]   print random floats and directions per
+//                                          second of glm/gtc/random's generators
+//
+// Batch options: --scene <file> --out <png> --size <W>x<H> --tile <pixels>
+//                --camera <x>,<y>,<z>,<lookUp>,<lookRight> --threads <count>
+// GL options:    --aa (adaptive anti-aliasing) --counters <png> (count rays and
+//                intersection tests, write a heatmap of tests per pixel)
+//                --compute (trace with the OpenGL 4.3 compute program)
+//                --compute-shared (same, scene copied to shared memory per tile)
+//                --bounces <n> --min-refl <weight> --roulette <depth> (reflection budget)
+//                --accumulate (average jittered frames) --samples <frames> (how many)
+//                --dof <aperture>,<focus distance> (thin lens, always averaged)
+//                --hybrid (rasterize primary visibility, trace shadows and reflections)
+//                --binning (primary rays search per tile primitive lists)
+//                --binning-view (same, the image shows the list lengths)
+//                --lights <count> (replace the scene's lights with random ones)
+//                --light-samples <n> (shadow rays per point with many lights, 0 = all)
+//                --light-scaling (time frames with 1 up to 4096 random lights)
+// Window:        --budget <ms> (start with dynamic resolution at that GPU frame time)
+//                --stats <csv> (per frame CPU and GPU pass times)
+// CPU options:   --numa (pin threads, node-local tiles) --replicate (scene copy
+//                per NUMA node) --scaling (time 1, 2, 4, ... threads)
+
+struct Options{
+	string mode;
+	string address;
+	string scene;
+	string out;
+	int width;
+	int height;
+	int tileSize;
+	int threads;
+	bool numa;
+	bool replicate;
+	bool scaling;
+	bool aa;
+	bool compute;
+	bool computeShared;
+	float budget;
+	string stats;
+	string counters;
+	int bounces;
+	float minRefl;
+	int roulette;
+	bool accumulate;
+	bool hybrid;
+	int binning;
+	int lights;
+	int lightSamples;
+	bool lightScaling;
+	int areaSamples;
+	bool dof;
+	float aperture;
+	float focusDistance;
+	int samples;
+	Camera camera;
+};
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+	options.scene = "scene1.txt";
+	options.out = "render.png";
+	options.width = 512;
+	options.height = 512;
+	options.tileSize = 32;
+	options.threads = std::max(1u, std::thread::hardware_concurrency());
+	options.numa = false;
+	options.replicate = false;
+	options.scaling = false;
+	options.aa = false;
+	options.compute = false;
+	options.computeShared = false;
+	options.budget = 0.f;
+	options.bounces = maxBounces;
+	options.minRefl = minReflCoeff;
+	options.roulette = rouletteDepth;
+	options.accumulate = false;
+	options.hybrid = false;
+	options.binning = 0;
+	options.lights = 0;
+	options.lightSamples = lightSamples;
+	options.lightScaling = false;
+	options.areaSamples = areaSamples;
+	options.dof = false;
+	options.aperture = aperture;
+	options.focusDistance = focusDistance;
+	options.samples = 64;
+	options.camera.pos = vec3(0.f);
+	options.camera.xRot = 0.f;
+	options.camera.yRot = 0.f;
+
+	for (int i = 1; i < argc; i++){
+		string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if ((arg == "--worker" || arg == "--coordinator") && hasValue){
+			options.mode = arg.substr(2);
+			options.address = argv[++i];
+		}
+		else if (arg == "--cpu")
+			options.mode = "cpu";
+		else if (arg == "--offscreen")
+			options.mode = "offscreen";
+		else if (arg == "--sampler-convergence")
+			options.mode = "samplers";
+		else if (arg == "--rng-throughput")
+			options.mode = "rng";
+		else if (arg == "--aa")
+			options.aa = true;
+		else if (arg == "--compute")
+			options.compute = true;
+		else if (arg == "--compute-shared")
+			options.compute = options.computeShared = true;
+		else if (arg == "--bounces" && hasValue)
+			options.bounces = std::max(0, atoi(argv[++i]));
+		else if (arg == "--min-refl" && hasValue)
+			options.minRefl = std::max(0.f, float(atof(argv[++i])));
+		else if (arg == "--roulette" && hasValue)
+			options.roulette = std::max(0, atoi(argv[++i]));
+		else if (arg == "--accumulate")
+			options.accumulate = true;
+		else if (arg == "--hybrid")
+			options.hybrid = true;
+		else if (arg == "--binning")
+			options.binning = 1;
+		else if (arg == "--binning-view")
+			options.binning = 2;
+		else if (arg == "--lights" && hasValue)
+			options.lights = std::max(0, atoi(argv[++i]));
+		else if (arg == "--light-samples" && hasValue)
+			options.lightSamples = std::max(0, atoi(argv[++i]));
+		else if (arg == "--light-scaling")
+			options.lightScaling = true;
+		else if (arg == "--area-samples" && hasValue)
+			options.areaSamples = std::max(1, atoi(argv[++i]));
+		else if (arg == "--dof" && hasValue){
+			options.dof = true;
+			if (sscanf(argv[++i], "%f,%f", &options.aperture, &options.focusDistance) != 2)
+				return false;
+		}
+		else if (arg == "--samples" && hasValue)
+			options.samples = std::max(1, atoi(argv[++i]));
+		else if (arg == "--counters" && hasValue)
+			options.counters = argv[++i];
+		else if (arg == "--stats" && hasValue)
+			options.stats = argv[++i];
+		else if (arg == "--budget" && hasValue)
+			options.budget = std::max(0.f, float(atof(argv[++i])));
+		else if (arg == "--threads" && hasValue)
+			options.threads = std::max(1, atoi(argv[++i]));
+		else if (arg == "--numa")
+			options.numa = true;
+		else if (arg == "--replicate")
+			options.replicate = options.numa = true;
+		else if (arg == "--scaling")
+			options.scaling = true;
+		else if (arg == "--scene" && hasValue)
+			options.scene = argv[++i];
+		else if (arg == "--out" && hasValue)
+			options.out = argv[++i];
+		else if (arg == "--size" && hasValue){
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+				return false;
+		}
+		else if (arg == "--tile" && hasValue)
+			options.tileSize = std::max(1, atoi(argv[++i]));
+		else if (arg == "--camera" && hasValue){
+			Camera &camera = options.camera;
+			if (sscanf(argv[++i], "%f,%f,%f,%f,%f", &camera.pos.x, &camera.pos.y, &camera.pos.z, &camera.xRot, &camera.yRot) != 5)
+				return false;
+		}
+		else {
+			cout << "Unknown option " << arg << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int runDistributed(const Options &options)
+{
+	RenderJob job;
+	job.sceneText = readFile(options.scene);
+	job.scene3 = isScene3(options.scene);
+	job.camera = options.camera;
+	job.width = options.width;
+	job.height = options.height;
+	job.tileSize = options.tileSize;
+
+	vector<unsigned char> rgb;
+	if (job.sceneText.empty() || !runCoordinator(options.address, job, rgb))
+		return -1;
+
+	if (!stbi_write_png(options.out.c_str(), job.width, job.height, 3, &rgb[0], job.width*3)){
+		cout << "ERROR: could not write " << options.out << endl;
+		return -1;
+	}
+	cout << "Wrote " << options.out << endl;
+	return 0;
+}
+
+int runCpu(const Options &options)
+{
+	string textData = readFile(options.scene);
+	if (textData.empty())
+		return -1;
+	parseObjects(textData);
+	Scene scene = buildScene(isScene3(options.scene));
+
+	CpuRenderOptions cpuOptions;
+	cpuOptions.threads = options.threads;
+	cpuOptions.tileSize = options.tileSize;
+	cpuOptions.numa = options.numa;
+	cpuOptions.replicateScene = options.replicate;
+	cpuOptions.report = true;
+
+	if (options.scaling){
+		cpuScaling(scene, options.camera, options.width, options.height, cpuOptions);
+		return 0;
+	}
+
+	vector<unsigned char> rgb;
+	renderCpu(scene, options.camera, options.width, options.height, cpuOptions, rgb);
+
+	if (!stbi_write_png(options.out.c_str(), options.width, options.height, 3, &rgb[0], options.width*3)){
+		cout << "ERROR: could not write " << options.out << endl;
+		return -1;
+	}
+	cout << "Wrote " << options.out << endl;
+	return 0;
+}
+
+EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+EGLContext headlessContext = EGL_NO_CONTEXT;
+
+//Releases the context of createHeadlessContext(), as glfwTerminate() does for
+//the window
+void destroyHeadlessContext()
+{
+	if (headlessDisplay == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (headlessContext != EGL_NO_CONTEXT)
+		eglDestroyContext(headlessDisplay, headlessContext);
+	eglTerminate(headlessDisplay);
+	headlessContext = EGL_NO_CONTEXT;
+	headlessDisplay = EGL_NO_DISPLAY;
+}
+
+//Creates an OpenGL 4.1 core context with no window or surface. Uses Mesa's
+//surfaceless platform when available, so it works without a display or GPU.
+bool createHeadlessContext()
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+		cout << "ERROR: could not initialize EGL" << endl;
+		return false;
+	}
+	headlessDisplay = display;
+	if (!eglBindAPI(EGL_OPENGL_API)){
+		cout << "ERROR: EGL has no desktop OpenGL support" << endl;
+		destroyHeadlessContext();
+		return false;
+	}
+
+	const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+	EGLConfig config;
+	EGLint configCount = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &configCount);
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	headlessContext = eglCreateContext(display, configCount > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+	if (headlessContext == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext)){
+		cout << "ERROR: could not create a surfaceless OpenGL 4.1 context (EGL error 0x"
+		     << hex << eglGetError() << dec << ")" << endl;
+		destroyHeadlessContext();
+		return false;
+	}
+	return true;
+}
+
+//Reads back the given target and writes it as a PNG, top row first
+bool writeTarget(int target, const string &filename)
+{
+	vector<unsigned char> pixels(fbWidth*fbHeight*3);
+	vector<unsigned char> flipped(pixels.size());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[target]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, fbWidth, fbHeight, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	int rowBytes = fbWidth*3;
+	for (int y = 0; y < fbHeight; y++)
+		copy(pixels.begin() + (fbHeight - 1 - y)*rowBytes, pixels.begin() + (fbHeight - y)*rowBytes, flipped.begin() + y*rowBytes);
+
+	return stbi_write_png(filename.c_str(), fbWidth, fbHeight, 3, &flipped[0], rowBytes) != 0;
+}
+
+//Median time of a few full traces, after one untimed trace that lets the
+//driver finish compiling the variant
+double medianTraceTime()
+{
+	loadFrameUniforms();
+	vector<double> times;
+	for (int i = 0; i < 4; i++){
+		auto start = chrono::steady_clock::now();
+		if (rasterizing())
+			rasterizeGBuffer();
+		if (binning())
+			binPrimitives();
+		traceFull();
+		glFinish();
+		if (i > 0)
+			times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	}
+	sort(times.begin(), times.end());
+	return times[times.size()/2];
+}
+
+//Frame times with 1 up to 4096 random lights in the scene, sampled from the
+//light tree and, up to 64 lights, with a shadow ray to every light
+int lightScaling(const Options &options)
+{
+	cout << "lights   sampled (" << options.lightSamples << " per point)   every light" << endl;
+	for (int count = 1; count <= 4096; count *= 4){
+		generatedLights = count;
+		if (!loadScene(options.scene))
+			return -1;
+		glUseProgram(shader[SHADER::LINE]);
+		lightSamples = std::max(options.lightSamples, 1);
+		double sampled = medianTraceTime();
+		printf("%6d   %10.1f ms", count, sampled);
+		if (count <= 64){
+			lightSamples = 0;
+			printf("   %10.1f ms", medianTraceTime());
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+	deleteIDs();
+	return CheckGLErrors("lightScaling") ? -1 : 0;
+}
+
+int renderOffscreen(const Options &options)
+{
+	initGL(options.width, options.height);
+	xPos = options.camera.pos.x;
+	yPos = options.camera.pos.y;
+	zPos = options.camera.pos.z;
+	lookUp = options.camera.xRot;
+	lookRight = options.camera.yRot;
+	adaptiveAA = options.aa;
+	maxBounces = options.bounces;
+	minReflCoeff = options.minRefl;
+	rouletteDepth = options.roulette;
+	temporalAccumulation = options.accumulate;
+	hybridRendering = options.hybrid;
+	tileBinning = options.binning;
+	generatedLights = options.lights;
+	lightSamples = options.lightSamples;
+	areaSamples = options.areaSamples;
+	focus = options.dof;
+	aperture = options.aperture;
+	focusDistance = options.focusDistance;
+	countersEnabled = !options.counters.empty();
+	if (countersEnabled)
+		initCounterTargets();
+	if (options.compute && computeTemplate.empty()){
+		cout << "ERROR: --compute needs OpenGL 4.3" << endl;
+		return -1;
+	}
+	computeTracer = options.compute;
+	sharedPrimitives = options.computeShared;
+	if (!loadScene(options.scene))
+		return -1;
+	reportStartup();
+
+	glUseProgram(shader[SHADER::LINE]);
+	glBindVertexArray(vao[VAO::LINES]);
+	if (options.lightScaling)
+		return lightScaling(options);
+
+	//the average is anti-aliased by its pixel jitter, like in the window
+	bool averaging = accumulating();
+	if (averaging)
+		adaptiveAA = false;
+	accumFrames = 0;
+	loadFrameUniforms();
+
+	//with counters the time includes reading them back, they only cover the
+	//first frame of an average
+	RayCounts traceCounts, aaCounts;
+	auto start = chrono::steady_clock::now();
+	if (countersEnabled)
+		clearCounters(FBO::TRACE);
+	if (rasterizing())
+		rasterizeGBuffer();
+	if (binning())
+		binPrimitives();
+	traceFull();
+	if (countersEnabled)
+		traceCounts = readCounters(FBO::TRACE, true);
+	if (averaging){
+		accumulate();
+		while (accumFrames < options.samples){
+			loadFrameUniforms();
+			traceFull();
+			accumulate();
+		}
+	}
+	if (adaptiveAA){
+		if (countersEnabled)
+			clearCounters(FBO::AA);
+		antialias();
+		if (countersEnabled)
+			aaCounts = readCounters(FBO::AA, false);
+	}
+	glFinish();
+	cout << "Traced " << fbWidth << "x" << fbHeight << " in "
+	     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms";
+	if (averaging)
+		cout << " (" << accumFrames << " frames averaged)";
+	cout << endl;
+	if (binning())
+		printBinStats();
+
+	if (countersEnabled){
+		printCounts("trace", traceCounts);
+		if (adaptiveAA)
+			printCounts("aa", aaCounts);
+		writeHeatmap(options.counters);
+	}
+
+	bool written = writeTarget(averaging ? accumTarget : adaptiveAA ? FBO::AA : FBO::TRACE, options.out);
+	if (CheckGLErrors("runOffscreen") || !written){
+		cout << "ERROR: could not write " << options.out << endl;
+		return -1;
+	}
+	cout << "Wrote " << options.out << endl;
+	deleteIDs();
+	return 0;
+}
+
+int runOffscreen(const Options &options)
+{
+	if (!createHeadlessContext())
+		return -1;
+	QueryGLVersion();
+	int result = renderOffscreen(options);
+	destroyHeadlessContext();
+	return result;
 }
 
 // ==========================================================================
@@ -725,6 +2910,27 @@ void initGL()
 
 int main(int argc, char *argv[])
 {   
+    launchTime = chrono::steady_clock::now();
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return -1;
+    if (options.mode == "worker")
+        return runWorker(options.address);
+    if (options.mode == "coordinator")
+        return runDistributed(options);
+    if (options.mode == "cpu")
+        return runCpu(options);
+    if (options.mode == "offscreen")
+        return runOffscreen(options);
+    if (options.mode == "samplers"){
+        samplerConvergence();
+        return 0;
+    }
+    if (options.mode == "rng"){
+        randomThroughput(options.threads);
+        return 0;
+    }
+
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initilize, TERMINATING" << endl;
@@ -737,7 +2943,7 @@ int main(int argc, char *argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    window = glfwCreateWindow(512, 512, "Susant Pant A4", 0, 0);
+    window = glfwCreateWindow(512, 512, WINDOW_TITLE, 0, 0);
     if (!window) {
         cout << "Program failed to create GLFW window, TERMINATING" << endl;
         glfwTerminate();
@@ -746,15 +2952,46 @@ int main(int argc, char *argv[])
 
     // set keyboard callback function and make our context current (active)
     glfwSetKeyCallback(window, KeyCallback);
+    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
+    glfwSetWindowRefreshCallback(window, WindowRefreshCallback);
     glfwMakeContextCurrent(window);
 
     // query and print out information about our OpenGL environment
     QueryGLVersion();
 
-	initGL();
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	initGL(width, height);
+	if (options.compute){
+		if (computeTemplate.empty())
+			cout << "Compute tracer: needs OpenGL 4.3, using the fragment tracer" << endl;
+		computeTracer = !computeTemplate.empty();
+		sharedPrimitives = computeTracer && options.computeShared;
+	}
+	temporalAccumulation = options.accumulate;
+	hybridRendering = options.hybrid;
+	tileBinning = options.binning;
+	generatedLights = options.lights;
+	lightSamples = options.lightSamples;
+	areaSamples = options.areaSamples;
+	focus = options.dof;
+	aperture = options.aperture;
+	focusDistance = options.focusDistance;
+	loadScene("scene1.txt");
+	reportStartup();
+	if (options.budget > 0.f){
+		dynamicResolution = true;
+		frameBudget = options.budget;
+	}
+	int status = 0;
+	if (!options.stats.empty() && !openStatsFile(options.stats))
+		status = -1;
+	maxBounces = options.bounces;
+	minReflCoeff = options.minRefl;
+	rouletteDepth = options.roulette;
 
     // run an event-triggered main loop
-    while (!glfwWindowShouldClose(window))
+    while (status == 0 && !glfwWindowShouldClose(window))
     {
     	if(incX)
     		xPos += 0.2f;
@@ -781,22 +3018,35 @@ int main(int argc, char *argv[])
     		lookUp += PI/90.f;
     	if(downRot)
     		lookUp -= PI/90.f;
-        // call function to draw our scene
-        render();
-
-        // scene is rendered to the back buffer, so swap to front for display
-        glfwSwapBuffers(window);
+    	bool moving = incX || decX || incZ || decZ || jump || upRot || downRot || leftRot || rightRot;
+    	if(moving)
+    		viewChanged = true;
+
+    	// only draw when the view changed, refinement or AA is unfinished, or the window lost its contents
+    	if (renderPending() || redrawPending){
+	        render();
+
+	        // scene is rendered to the back buffer, so swap to front for display
+	        auto swapStart = chrono::steady_clock::now();
+	        glfwSwapBuffers(window);
+	        recordSwap(chrono::duration<double, milli>(chrono::steady_clock::now() - swapStart).count());
+	        redrawPending = false;
+    	}
 
-        // sleep until next event before drawing again
-        glfwPollEvents();
+        // keep going while there is work left, otherwise sleep until the next event
+        if (moving || renderPending())
+        	glfwPollEvents();
+        else
+        	glfwWaitEvents();
 	}
 
 	// clean up allocated resources before exit
+	finishFrameStats();
 	deleteIDs();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 
-   return 0;
+   return status;
 }
 
 // ==========================================================================
@@ -921,3 +3171,163 @@ GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
 
     return programObject;
 }
+
+// --------------------------------------------------------------------------
+// Program binary cache
+//
+// Linked programs are saved to shadercache/ with glGetProgramBinary and loaded
+// back with glProgramBinary on later runs. The file name is a hash of both
+// sources and the driver strings, so editing a shader or changing driver just
+// misses the cache. Any failure falls back to compiling from source
+
+const char *SHADER_CACHE_DIR = "shadercache";
+const uint32_t SHADER_CACHE_MAGIC = 0x42505452;		//"RTPB"
+
+// 64-bit FNV-1a
+uint64_t HashString(const string &text, uint64_t hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// the sources are separated by a NUL, programs with other stages never collide
+string ProgramCachePath(const vector<string> &sources)
+{
+    string driver = string(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + '\n'
+                  + reinterpret_cast<const char *>(glGetString(GL_RENDERER)) + '\n'
+                  + reinterpret_cast<const char *>(glGetString(GL_VERSION)) + '\n';
+    uint64_t hash = HashString(driver);
+    for (size_t i = 0; i < sources.size(); i++)
+        hash = HashString((i > 0 ? string(1, '\0') : string()) + sources[i], hash);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+// returns 0 if there is no usable binary for this driver
+GLuint LoadProgramBinary(const string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+
+    uint32_t header[2];
+    vector<char> binary;
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == SHADER_CACHE_MAGIC;
+    if (ok) {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file) - (long)sizeof(header);
+        fseek(file, sizeof(header), SEEK_SET);
+        ok = size > 0;
+        if (ok) {
+            binary.resize(size);
+            ok = fread(&binary[0], 1, size, file) == (size_t)size;
+        }
+    }
+    fclose(file);
+    if (!ok)
+        return 0;
+
+    GLuint programObject = glCreateProgram();
+    glProgramBinary(programObject, header[1], &binary[0], binary.size());
+
+    // the driver may reject binaries from an older build of itself
+    GLint status;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        glDeleteProgram(programObject);
+        return 0;
+    }
+    return programObject;
+}
+
+void SaveProgramBinary(GLuint programObject, const string &path)
+{
+    GLint length = 0;
+    glGetProgramiv(programObject, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(programObject, length, &length, &format, &binary[0]);
+    if (CheckGLErrors("SaveProgramBinary"))
+        return;
+
+    mkdir(SHADER_CACHE_DIR, 0755);
+    // write to a temporary name first so a concurrent run never reads half a file,
+    // one per process so two runs saving the same program don't share it
+    string temporary = path + "." + to_string(getpid()) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        cout << "WARNING: could not write shader cache " << path << endl;
+        return;
+    }
+    uint32_t header[2] = { SHADER_CACHE_MAGIC, format };
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1
+           && fwrite(&binary[0], 1, length, file) == (size_t)length;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+// creates a program from the binary cache, or compiles and links it and caches the result
+GLuint BuildProgramStages(const vector<GLenum> &types, const vector<string> &sources, bool &fromCache)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    string path;
+    if (formats > 0) {
+        path = ProgramCachePath(sources);
+        GLuint programObject = LoadProgramBinary(path);
+        if (programObject) {
+            fromCache = true;
+            return programObject;
+        }
+    }
+    fromCache = false;
+
+    GLuint programObject = glCreateProgram();
+    vector<GLuint> shaderIDs;
+    for (size_t i = 0; i < types.size(); i++) {
+        shaderIDs.push_back(CompileShader(types[i], sources[i]));
+        glAttachShader(programObject, shaderIDs.back());
+    }
+    if (formats > 0)
+        glProgramParameteri(programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(programObject);
+    for (GLuint shaderID : shaderIDs)
+        glDeleteShader(shaderID);
+
+    GLint status;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        GLint length;
+        glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
+        string info(length, ' ');
+        glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
+        cout << "ERROR linking shader program:" << endl;
+        cout << info << endl;
+    }
+    else if (formats > 0) {
+        SaveProgramBinary(programObject, path);
+    }
+
+    return programObject;
+}
+
+GLuint BuildProgram(const string &vertexSource, const string &fragmentSource, bool &fromCache)
+{
+    return BuildProgramStages({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}, {vertexSource, fragmentSource}, fromCache);
+}
+
+GLuint BuildComputeProgram(const string &computeSource, bool &fromCache)
+{
+    return BuildProgramStages({GL_COMPUTE_SHADER}, {computeSource}, fromCache);
+}
@@ -0,0 +1,20 @@
+// ==========================================================================
+// Fragment program which scatters a reduced density trace pass into the
+// pixels it was traced for (progressive refinement)
+// ==========================================================================
+#version 410
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+uniform sampler2D lowRes;
+uniform int stride;
+uniform ivec2 offset;
+
+void main(void){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	if (any(notEqual(pixel % stride, offset))){
+		discard;
+	}
+	FragmentColour = texelFetch(lowRes, pixel / stride, 0);
+}
@@ -0,0 +1,303 @@
+// ==========================================================================
+// Low-discrepancy sample sequences
+// ==========================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "glm/gtc/random.hpp"
+#include "sampler.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+//Direction numbers of the first dimensions (Joe and Kuo), each column
+//as 32 bit fixed point
+struct SobolMatrices{
+	uint32_t directions[SOBOL_DIMENSIONS][32];
+
+	SobolMatrices(){
+		//degree s and coefficients a of the primitive polynomial, initial m
+		const int degree[SOBOL_DIMENSIONS] = {0, 1, 2, 3};
+		const uint32_t coefficients[SOBOL_DIMENSIONS] = {0, 0, 1, 1};
+		const uint32_t initial[SOBOL_DIMENSIONS][3] = {{0, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+		for (int bit = 0; bit < 32; bit++)
+			directions[0][bit] = 1u << (31 - bit);
+		for (int d = 1; d < SOBOL_DIMENSIONS; d++){
+			int s = degree[d];
+			uint32_t *v = directions[d];
+			for (int k = 0; k < 32; k++){
+				if (k < s){
+					v[k] = initial[d][k] << (31 - k);
+					continue;
+				}
+				v[k] = v[k - s] ^ (v[k - s] >> s);
+				for (int j = 1; j < s; j++){
+					if ((coefficients[d] >> (s - 1 - j)) & 1)
+						v[k] ^= v[k - j];
+				}
+			}
+		}
+	}
+};
+
+const SobolMatrices sobolMatrices;
+
+uint32_t reverseBits(uint32_t x){
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+//Laine and Karras' hash: bit i of the result only depends on bits 0..i of x,
+//so applied to the reversed bits it permutes every subinterval of [0,1) as
+//a whole, which is what an Owen scramble is
+uint32_t nestedUniformScramble(uint32_t x, uint32_t seed){
+	x = reverseBits(x);
+	x += seed;
+	x ^= x*0x6c50b47cu;
+	x ^= x*0xb82f1e52u;
+	x ^= x*0xc7afe638u;
+	x ^= x*0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+uint32_t hashCombine(uint32_t seed, uint32_t value){
+	return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+float unitFloat(uint32_t bits){
+	//the top 24 bits, so the result stays below 1
+	return float(bits >> 8)*(1.f/16777216.f);
+}
+
+//Test integrands over the unit square with known integrals
+float smooth(vec2 p){
+	return exp(-dot(p - 0.5f, p - 0.5f)*4.f);
+}
+
+float edge(vec2 p){
+	//a straight edge across the square at an angle, like a pixel on a silhouette
+	return (p.y < 0.3f + 0.45f*p.x) ? 1.f : 0.f;
+}
+
+//Values each thread makes per run of randomThroughput(), and per batch call
+const int THROUGHPUT_SAMPLES = 1 << 21;
+const int BATCH = 1024;
+
+//One thread's share: count floats (or directions) summed so the work stays.
+//Seeded per thread so each thread draws its own sequence
+float drawFloats(int method, int count, unsigned seed){
+	float sum = 0.f;
+	if (method == 0){
+		for (int i = 0; i < count; i++)
+			sum += linearRand(0.f, 1.f);
+	}
+	else if (method == 1){
+		pcg32 generator(1, seed);
+		for (int i = 0; i < count; i++)
+			sum += linearRand(0.f, 1.f, generator);
+	}
+	else if (method == 2){
+		xoshiro128p generator(seed + 1);
+		for (int i = 0; i < count; i++)
+			sum += linearRand(0.f, 1.f, generator);
+	}
+	else {
+		xoshiro128p_x4 generator(seed + 1);
+		float batch[BATCH];
+		for (int i = 0; i < count; i += BATCH){
+			linearRand(batch, BATCH, 0.f, 1.f, generator);
+			for (int j = 0; j < BATCH; j++)
+				sum += batch[j];
+		}
+	}
+	return sum;
+}
+
+float drawDirections(int method, int count, unsigned seed){
+	vec3 sum(0.f);
+	if (method == 0){
+		for (int i = 0; i < count; i++)
+			sum += sphericalRand(1.f);
+	}
+	else if (method == 1){
+		pcg32 generator(1, seed);
+		for (int i = 0; i < count; i++)
+			sum += sphericalRand(1.f, generator);
+	}
+	else if (method == 2){
+		xoshiro128p generator(seed + 1);
+		for (int i = 0; i < count; i++)
+			sum += sphericalRand(1.f, generator);
+	}
+	else {
+		xoshiro128p_x4 generator(seed + 1);
+		vec3 batch[BATCH];
+		for (int i = 0; i < count; i += BATCH){
+			sphericalRand(batch, BATCH, 1.f, generator);
+			for (int j = 0; j < BATCH; j++)
+				sum += batch[j];
+		}
+	}
+	return sum.x + sum.y + sum.z;
+}
+
+//One thread's result, padded to a cache line so the threads finishing at
+//different times don't invalidate each other's line
+struct ThreadSum{
+	float sum;
+	char pad[64 - sizeof(float)];
+};
+
+//Millions of values per second over all threads, best of three runs
+double throughput(bool directions, int method, int threads){
+	double best = 0.0;
+	for (int repeat = 0; repeat < 3; repeat++){
+		vector<thread> workers;
+		vector<ThreadSum> sums(threads);
+		auto start = chrono::steady_clock::now();
+		for (int t = 0; t < threads; t++){
+			workers.push_back(thread([=, &sums](){
+				sums[t].sum = directions ? drawDirections(method, THROUGHPUT_SAMPLES, t) : drawFloats(method, THROUGHPUT_SAMPLES, t);
+			}));
+		}
+		for (thread &worker : workers)
+			worker.join();
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		best = std::max(best, double(threads)*THROUGHPUT_SAMPLES/seconds*1e-6);
+	}
+	return best;
+}
+
+}
+
+uint32_t sampleHash(uint32_t x){
+	x = x*747796405u + 2891336453u;
+	x = ((x >> ((x >> 28u) + 4u)) ^ x)*277803737u;
+	return (x >> 22u) ^ x;
+}
+
+uint32_t pixelSeed(uint32_t x, uint32_t y, uint32_t salt){
+	return sampleHash(sampleHash(sampleHash(x) ^ y) ^ salt);
+}
+
+uint32_t sobol(uint32_t index, int dimension){
+	uint32_t result = 0;
+	for (int bit = 0; index != 0; bit++, index >>= 1){
+		if (index & 1)
+			result ^= sobolMatrices.directions[dimension][bit];
+	}
+	return result;
+}
+
+float sobolOwen(uint32_t index, int dimension, uint32_t seed){
+	uint32_t shuffled = nestedUniformScramble(index, seed);
+	return unitFloat(nestedUniformScramble(sobol(shuffled, dimension), hashCombine(seed, dimension)));
+}
+
+vec2 sobolOwen2(uint32_t index, uint32_t seed){
+	return vec2(sobolOwen(index, 0, seed), sobolOwen(index, 1, seed));
+}
+
+vec2 r2(uint32_t index, vec2 offset){
+	//1/g and 1/g^2 for g the plastic number, the real root of x^3 = x + 1
+	const vec2 alpha(0.7548776662f, 0.5698402910f);
+	return fract(offset + float(index)*alpha);
+}
+
+void samplerConvergence(){
+	//reference integrals from a 4096x4096 grid of midpoints
+	const int GRID = 4096;
+	double reference[2] = {0.0, 0.0};
+	for (int y = 0; y < GRID; y++){
+		for (int x = 0; x < GRID; x++){
+			vec2 p((x + 0.5f)/GRID, (y + 0.5f)/GRID);
+			reference[0] += smooth(p);
+			reference[1] += edge(p);
+		}
+	}
+	reference[0] /= double(GRID)*GRID;
+	reference[1] /= double(GRID)*GRID;
+
+	//every estimate is repeated for this many "pixels", each with its own seed
+	const int TRIALS = 256;
+	const char *names[3] = {"random", "R2", "Owen-Sobol"};
+	const char *integrands[2] = {"smooth", "edge"};
+	mt19937 generator(1);
+	uniform_real_distribution<float> unit(0.f, 1.f);
+
+	for (int f = 0; f < 2; f++){
+		cout << integrands[f] << " integrand, RMS error over " << TRIALS << " seeds" << endl;
+		cout << "points" << setw(14) << names[0] << setw(14) << names[1] << setw(14) << names[2] << endl;
+		double first[3], last[3];
+		int firstCount = 0, lastCount = 0;
+		for (int count = 1; count <= 4096; count *= 4){
+			double error[3] = {0.0, 0.0, 0.0};
+			for (int trial = 0; trial < TRIALS; trial++){
+				uint32_t seed = pixelSeed(trial % 16, trial/16, 0);
+				vec2 offset(unit(generator), unit(generator));
+				double sum[3] = {0.0, 0.0, 0.0};
+				for (int i = 0; i < count; i++){
+					vec2 points[3] = {vec2(unit(generator), unit(generator)), r2(i, offset), sobolOwen2(i, seed)};
+					for (int s = 0; s < 3; s++)
+						sum[s] += f == 0 ? smooth(points[s]) : edge(points[s]);
+				}
+				for (int s = 0; s < 3; s++){
+					double difference = sum[s]/count - reference[f];
+					error[s] += difference*difference;
+				}
+			}
+			cout << setw(6) << count;
+			for (int s = 0; s < 3; s++){
+				error[s] = sqrt(error[s]/TRIALS);
+				cout << setw(14) << scientific << setprecision(3) << error[s];
+			}
+			cout << defaultfloat << endl;
+			if (count == 16){
+				firstCount = count;
+				copy(error, error + 3, first);
+			}
+			lastCount = count;
+			copy(error, error + 3, last);
+		}
+		//slope of log(error) over log(points) from 16 points on, -0.5 for random
+		cout << "rate  ";
+		for (int s = 0; s < 3; s++)
+			cout << setw(14) << fixed << setprecision(2) << log(last[s]/first[s])/log(double(lastCount)/firstCount);
+		cout << defaultfloat << endl << endl;
+	}
+}
+
+void randomThroughput(int maxThreads){
+	vector<int> counts;
+	for (int threads = 1; threads < maxThreads; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(std::max(1, maxThreads));
+
+	const char *methods[4] = {"std::rand", "pcg32", "xoshiro128p", "xoshiro128p_x4"};
+	const char *kinds[2] = {"floats", "directions"};
+	for (int kind = 0; kind < 2; kind++){
+		cout << "millions of " << kinds[kind] << " per second" << endl;
+		cout << "threads";
+		for (int method = 0; method < 4; method++)
+			cout << setw(16) << methods[method];
+		cout << endl;
+		for (int threads : counts){
+			cout << setw(7) << threads;
+			for (int method = 0; method < 4; method++)
+				cout << setw(16) << fixed << setprecision(1) << throughput(kind == 1, method, threads);
+			cout << defaultfloat << endl;
+		}
+		cout << endl;
+	}
+}
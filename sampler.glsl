@@ -0,0 +1,59 @@
+// ==========================================================================
+// Low-discrepancy sample sequences, the GLSL side of sampler.h: the same
+// hash, Owen-scrambled Sobol points (dimensions 0 and 1) and R2 sequence,
+// bit for bit. Included by trace.glsl
+// ==========================================================================
+
+uint hash(uint x){
+	x = x * 747796405u + 2891336453u;
+	x = ((x >> ((x >> 28u) + 4u)) ^ x) * 277803737u;
+	return (x >> 22u) ^ x;
+}
+
+uint pixelSeed(uvec2 pixel, uint salt){
+	return hash(hash(hash(pixel.x) ^ pixel.y) ^ salt);
+}
+
+// dimensions 0 and 1 of the Sobol sequence: the bits of index reversed, and
+// direction numbers v(k) = v(k-1) ^ (v(k-1) >> 1)
+uvec2 sobol2(uint index){
+	uvec2 result = uvec2(0u);
+	uint direction = 0x80000000u;
+	for (int bit = 0; bit < 32 && index != 0u; bit++){
+		if ((index & 1u) != 0u){
+			result ^= uvec2(0x80000000u >> uint(bit), direction);
+		}
+		direction ^= direction >> 1u;
+		index >>= 1u;
+	}
+	return result;
+}
+
+// Owen scramble of every subinterval at once (Laine-Karras hash on the
+// reversed bits)
+uint nestedUniformScramble(uint x, uint seed){
+	x = bitfieldReverse(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return bitfieldReverse(x);
+}
+
+uint hashCombine(uint seed, uint value){
+	return seed ^ (value + (seed << 6u) + (seed >> 2u));
+}
+
+// point index of the Sobol sequence shuffled and scrambled by seed
+vec2 sobolOwen2(uint index, uint seed){
+	uvec2 bits = sobol2(nestedUniformScramble(index, seed));
+	bits = uvec2(nestedUniformScramble(bits.x, hashCombine(seed, 0u)),
+	             nestedUniformScramble(bits.y, hashCombine(seed, 1u)));
+	return vec2(bits >> 8u) * (1.0 / 16777216.0);
+}
+
+// point index of the R2 sequence shifted by offset
+vec2 r2(uint index, vec2 offset){
+	return fract(offset + float(index) * vec2(0.7548776662, 0.5698402910));
+}
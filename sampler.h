@@ -0,0 +1,54 @@
+// ==========================================================================
+// Low-discrepancy sample sequences
+//
+// Owen-scrambled Sobol points and the R2 sequence, the same in C++ and in
+// sampler.glsl. A sequence fills the unit square far more evenly than random
+// points, so averages over it converge faster: for a pixel footprint or the
+// visible part of a light about as N^-0.75 instead of N^-0.5. Each pixel
+// gets its own scramble (a seed from pixelSeed) or offset, which keeps the
+// error of neighbouring pixels independent instead of repeating one pattern
+// over the image.
+// ==========================================================================
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include "glm/glm.hpp"
+
+const int SOBOL_DIMENSIONS = 4;
+
+//The hash random() uses in trace.glsl
+uint32_t sampleHash(uint32_t x);
+
+//Seed of pixel (x, y) for one use (salt), so different uses of the same
+//pixel are scrambled independently
+uint32_t pixelSeed(uint32_t x, uint32_t y, uint32_t salt);
+
+//Unscrambled Sobol point index in dimension 0..SOBOL_DIMENSIONS-1, as 32 bit
+//fixed point
+uint32_t sobol(uint32_t index, int dimension);
+
+//Point index of the Sobol sequence with the index shuffled and the value
+//Owen-scrambled by seed (Burley 2020, hash-based Owen scrambling). Every seed
+//gives a sequence just as evenly spread as the original one
+float sobolOwen(uint32_t index, int dimension, uint32_t seed);
+
+//Dimensions 0 and 1, the pair sobolOwen2() in sampler.glsl returns
+glm::vec2 sobolOwen2(uint32_t index, uint32_t seed);
+
+//Point index of the R2 sequence (Roberts 2018) shifted by offset, which is
+//how it is decorrelated per pixel
+glm::vec2 r2(uint32_t index, glm::vec2 offset);
+
+//Prints the RMS error of uniform random, R2 and Owen-scrambled Sobol points
+//integrating a smooth and a discontinuous function over the unit square,
+//for 1 to 4096 points, and the rate the error falls at
+void samplerConvergence();
+
+//Prints millions of random floats and directions per second made by
+//glm/gtc/random on std::rand(), on a pcg32 or xoshiro128p owned by each
+//thread and batched on xoshiro128p_x4, with 1, 2, 4, ... up to maxThreads
+//threads
+void randomThroughput(int maxThreads);
+
+#endif
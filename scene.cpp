@@ -0,0 +1,177 @@
+// ==========================================================================
+// Scene file parsing
+// ==========================================================================
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "scene.h"
+#include "arena.h"
+
+using namespace std;
+using namespace glm;
+
+vector<vec3> triangleVecs;
+vector<vec3> sphereVecs;
+vector<vec3> planeVecs;
+vector<vec3> lightVecs;
+vector<vec3> areaLightVecs;
+
+string readFile(string filename){
+	ifstream myFile;
+	
+	myFile.open(filename);
+	
+	myFile.seekg(0, myFile.end);
+	int length = (myFile.tellg());
+	myFile.seekg(0,myFile.beg);
+
+	if (length <= 0){
+		cout << "ERROR: Could not load scene from file " << filename << endl;
+		return string();
+	}
+
+	char *buffer = new char[length];
+	myFile.read(buffer,length);
+	myFile.close();
+
+	string retString(buffer, length);
+	delete[] buffer;
+	return retString;
+}
+
+void parse(const char *line, int id){
+	char *end;
+	float x = strtof(line, &end);
+	float y = strtof(end, &end);
+	float z = strtof(end, &end);
+
+	switch (id) {
+		case 0 :
+			triangleVecs.push_back(vec3(x,y,z));
+			break;
+		case 1 :
+			sphereVecs.push_back(vec3(x,y,z));
+			break;
+		case 2 :
+			planeVecs.push_back(vec3(x,y,z));
+			break;
+		case 3 :
+			lightVecs.push_back(vec3(x,y,z));
+			break;
+		case 4 :
+			areaLightVecs.push_back(vec3(x,y,z));
+			break;
+	}
+}
+
+void parseObjects(string textData){
+	//The text is copied into an arena and split into lines in place, instead of
+	//allocating a string per line
+	static Arena loaderArena(64*1024);
+	loaderArena.reset();
+
+	char *text = loaderArena.allocArray<char>(textData.size() + 1);
+	memcpy(text, textData.c_str(), textData.size() + 1);
+	char **lines = loaderArena.allocArray<char *>(count(textData.begin(), textData.end(), '\n') + 1);
+	unsigned lineCount = 0;
+	char *save;
+	for (char *line = strtok_r(text, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save))
+		lines[lineCount++] = line;
+
+	for (unsigned i = 0; i < lineCount; i++){
+		char id = lines[i][0];
+		if (id == 't' && i + 5 < lineCount){
+			parse(lines[i+1], 0);
+			parse(lines[i+2], 0);
+			parse(lines[i+3], 0);
+			parse(lines[i+4], 0);
+			parse(lines[i+5], 0);
+			i+=5;
+		}
+		else if (id == 's' && i + 4 < lineCount){
+			parse(lines[i+1], 1);
+			parse(lines[i+2], 1);
+			parse(lines[i+3], 1);
+			parse(lines[i+4], 1);
+			i+=4;
+		}
+		else if (id == 'p' && i + 4 < lineCount){
+			parse(lines[i+1], 2);
+			parse(lines[i+2], 2);
+			parse(lines[i+3], 2);
+			parse(lines[i+4], 2);
+			i+=4;
+		}
+		else if (id == 'l' && i + 3 < lineCount && strchr("0123456789+-.", lines[i+3][0])){
+			//a third line is the radius of a spherical light
+			parse(lines[i+1], 4);
+			parse(lines[i+3], 4);
+			areaLightVecs.push_back(vec3(0.f));
+			parse(lines[i+2], 4);
+			i+=3;
+		}
+		else if (id == 'l' && i + 2 < lineCount){
+			parse(lines[i+1], 3);
+			parse(lines[i+2], 3);
+			i+=2;
+		}
+		else if (id == 'a' && i + 4 < lineCount){
+			parse(lines[i+1], 4);
+			parse(lines[i+2], 4);
+			parse(lines[i+3], 4);
+			parse(lines[i+4], 4);
+			i+=4;
+		}
+		else{
+			//do nothing
+		}
+	}
+}
+
+Scene buildScene(bool scene3){
+	Scene scene;
+	scene.scene3 = scene3;
+
+	for (unsigned i = 0; i + 4 < triangleVecs.size(); i += 5){
+		Triangle triangle;
+		triangle.p0 = triangleVecs[i];
+		triangle.p1 = triangleVecs[i+1];
+		triangle.p2 = triangleVecs[i+2];
+		triangle.color = triangleVecs[i+3];
+		triangle.p = triangleVecs[i+4].x;
+		triangle.specCol = triangleVecs[i+4].y;
+		triangle.ref = triangleVecs[i+4].z;
+		scene.triangles.push_back(triangle);
+	}
+	for (unsigned i = 0; i + 3 < sphereVecs.size(); i += 4){
+		Sphere sphere;
+		sphere.center = sphereVecs[i];
+		sphere.radius = sphereVecs[i+1].x;
+		sphere.color = sphereVecs[i+2];
+		sphere.p = sphereVecs[i+3].x;
+		sphere.specCol = sphereVecs[i+3].y;
+		sphere.ref = sphereVecs[i+3].z;
+		scene.spheres.push_back(sphere);
+	}
+	for (unsigned i = 0; i + 3 < planeVecs.size(); i += 4){
+		Plane plane;
+		plane.normal = planeVecs[i];
+		plane.point = planeVecs[i+1];
+		plane.color = planeVecs[i+2];
+		plane.p = planeVecs[i+3].x;
+		plane.specCol = planeVecs[i+3].y;
+		plane.ref = planeVecs[i+3].z;
+		scene.planes.push_back(plane);
+	}
+	for (unsigned i = 0; i + 1 < lightVecs.size(); i += 2){
+		Light light;
+		light.pos = lightVecs[i];
+		light.color = lightVecs[i+1];
+		scene.lights.push_back(light);
+	}
+
+	return scene;
+}
@@ -0,0 +1,73 @@
+// ==========================================================================
+// Scene description shared by the GLSL tracer and the CPU tracer
+//
+// The scene files are parsed into flat lists of vec3s (one per line of a
+// block), which loadUniformBuffer() uploads directly and buildScene() packs
+// into the structs below. The structs mirror the ones in fragment.glsl.
+// ==========================================================================
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+struct Triangle{
+	glm::vec3 p0;
+	glm::vec3 p1;
+	glm::vec3 p2;
+	glm::vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Sphere{
+	glm::vec3 center;
+	float radius;
+	glm::vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Plane{
+	glm::vec3 normal;
+	glm::vec3 point;
+	glm::vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Light{
+	glm::vec3 pos;
+	glm::vec3 color;
+};
+
+struct Scene{
+	std::vector<Triangle> triangles;
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	std::vector<Light> lights;
+	bool scene3;		//Scene 3 uses no epsilon on secondary rays
+};
+
+//Lines of the scene file blocks, filled in by parseObjects()
+extern std::vector<glm::vec3> triangleVecs;
+extern std::vector<glm::vec3> sphereVecs;
+extern std::vector<glm::vec3> planeVecs;
+extern std::vector<glm::vec3> lightVecs;
+//Area lights, four lines each: centre, edges and colour of a rectangle (area
+//blocks), or centre, (radius, 0, 0), zero and colour of a sphere (light blocks
+//with a radius line). Only the GLSL tracer shades them
+extern std::vector<glm::vec3> areaLightVecs;
+
+std::string readFile(std::string filename);
+void parse(const char *line, int id);
+void parseObjects(std::string textData);
+
+//Packs the parsed lists into a Scene, leaving the lists untouched
+Scene buildScene(bool scene3);
+
+#endif
@@ -0,0 +1,1022 @@
+// ==========================================================================
+// Ray tracer shared by the fragment (fragment.glsl) and compute (compute.glsl)
+// programs. The host pastes it in place of their #include "trace.glsl" line
+// ==========================================================================
+
+uniform float xPos;
+uniform float yPos;
+uniform float zPos;
+
+struct Plane{
+	vec3 normal;		// unit length, normalized on upload
+	vec3 point;
+	vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Sphere{
+	vec3 center;
+	float radius;
+	float radius2;		// radius*radius
+	float centerDot;	// dot(center, center)
+	vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Triangle{
+	vec3 p0;
+	vec3 e1;		// p1 - p0
+	vec3 e2;		// p2 - p0
+	vec3 normal;		// normalize(cross(e1, e2))
+	vec3 color;
+	float p;
+	float specCol;
+	float ref;
+};
+
+struct Light{
+	vec3 pos;
+	vec3 color;
+};
+
+// a rectangle spanning centre +- edge1/2 +- edge2/2, or a sphere when radius
+// is above 0. Point lights are spheres of radius 0
+struct AreaLight{
+	vec3 centre;
+	vec3 edge1;
+	vec3 edge2;
+	vec3 color;
+	float radius;
+};
+
+// scene specialization: the host prepends #defines with the scene's primitive
+// counts and feature switches, the fallbacks below are the unspecialized limits
+#ifndef NUM_TRIANGLES
+#define NUM_TRIANGLES 50
+#endif
+#ifndef NUM_SPHERES
+#define NUM_SPHERES 10
+#endif
+#ifndef NUM_PLANES
+#define NUM_PLANES 2
+#endif
+#ifndef ENABLE_REFLECTIONS
+#define ENABLE_REFLECTIONS 1
+#endif
+#ifndef ENABLE_DOF
+#define ENABLE_DOF 0
+#endif
+#ifndef ENABLE_COUNTERS
+#define ENABLE_COUNTERS 0
+#endif
+#ifndef BORDER
+#define BORDER 0.001		// epsilon on secondary rays, scene 3 uses 0.0
+#endif
+#ifndef SHARED_PRIMITIVES
+#define SHARED_PRIMITIVES 0
+#endif
+#ifndef ENABLE_REPROJECTION
+#define ENABLE_REPROJECTION 0
+#endif
+#ifndef ENABLE_GBUFFER
+#define ENABLE_GBUFFER 0
+#endif
+#ifndef ENABLE_TILE_LISTS
+#define ENABLE_TILE_LISTS 0
+#endif
+#ifndef MANY_LIGHTS
+#define MANY_LIGHTS 0
+#endif
+#ifndef NUM_AREA_LIGHTS
+#define NUM_AREA_LIGHTS 0
+#endif
+
+// GLSL arrays cannot be empty, loops only run up to the NUM_ counts
+uniform Triangle triangles[max(NUM_TRIANGLES, 1)];
+uniform Sphere spheres[max(NUM_SPHERES, 1)];
+uniform Plane planes[max(NUM_PLANES, 1)];
+uniform Light lights[1];		// more lights take the MANY_LIGHTS or area light path
+
+// the compute tracer can copy the primitives into workgroup shared memory once
+// per 8x8 tile, every intersection loop below then reads them from there
+#if SHARED_PRIMITIVES
+shared Triangle sharedTriangles[max(NUM_TRIANGLES, 1)];
+shared Sphere sharedSpheres[max(NUM_SPHERES, 1)];
+shared Plane sharedPlanes[max(NUM_PLANES, 1)];
+#define TRIANGLES sharedTriangles
+#define SPHERES sharedSpheres
+#define PLANES sharedPlanes
+
+void loadSharedPrimitives(){
+	int lane = int(gl_LocalInvocationIndex);
+	int lanes = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);
+	for (int i = lane; i < NUM_TRIANGLES; i += lanes){
+		sharedTriangles[i] = triangles[i];
+	}
+	for (int i = lane; i < NUM_SPHERES; i += lanes){
+		sharedSpheres[i] = spheres[i];
+	}
+	for (int i = lane; i < NUM_PLANES; i += lanes){
+		sharedPlanes[i] = planes[i];
+	}
+	memoryBarrierShared();
+	barrier();
+}
+#else
+#define TRIANGLES triangles
+#define SPHERES spheres
+#define PLANES planes
+#endif
+
+// instrumentation: per pixel counts the stage writes out with writeCounters()
+// counts0 = triangle, sphere and plane intersection tests, shadow rays
+// counts1 = reflection bounces, rays that left the scene, primary rays,
+//           primary hits whose colour was reprojected from the previous frame
+#if ENABLE_COUNTERS
+uvec4 counts0 = uvec4(0);
+uvec4 counts1 = uvec4(0);
+#define COUNT(counter) counter++
+#else
+#define COUNT(counter)
+#endif
+
+float PI = 3.1415926535897932384626433832795;
+float FOV = PI/3.0;
+float minDist = 100000.0;
+vec3 x_axis = vec3(1.0,0.0,0.0);
+vec3 y_axis = vec3(0.0,1.0,0.0);
+vec3 z_axis = vec3(0.0,0.0,1.0);
+
+float intersectPlane(vec3 dir, Plane plane, vec3 start){
+	vec3 disp = plane.point - start;
+	float numer = dot(plane.normal, disp);
+	float denom = dot(dir, plane.normal);
+	if (denom == 0.0){	
+		return -1.0;
+	}
+	float t = numer/denom;
+	return t;
+}
+
+float intersectSphere(vec3 dir, Sphere sphere, vec3 start){
+	float a = dot(dir, dir);
+	float b = 2.0 * (dot(start, dir) - dot(sphere.center, dir));
+	float c = (-2.0*dot(start, sphere.center)) + dot(start, start) + sphere.centerDot - sphere.radius2;
+	float discriminant = b*b - 4.0*a*c;
+	if (discriminant < 0){
+		return -1.0;
+	}
+	float t1 = (-b + sqrt(discriminant)) / 2.0*a;
+	float t2 = (-b - sqrt(discriminant)) / 2.0*a;
+	float retVal = min(t1,t2);
+	if (retVal < 0.0){
+		retVal = max(t1,t2);
+	}
+	return retVal;
+}
+
+float intersectTriangle(vec3 dir, Triangle triangle, vec3 start){
+	// Cramer's rule on the precomputed edges, each determinant is a triple
+	// product so two cross products cover all four of them. cross(e1, e2) is
+	// not stored: on llvmpipe, reading it as a fourth vec3 made whole traces
+	// about 7% slower than computing it here
+	vec3 s = start - triangle.p0;
+	vec3 n = cross(triangle.e1, triangle.e2);
+	vec3 q = cross(dir, s);
+	float denom = 1.0/(-dot(dir, n));
+
+	float t = dot(s, n) * denom;
+	float u = -dot(triangle.e2, q) * denom;
+	float v = dot(triangle.e1, q) * denom;
+
+	if ((u+v) < 1.0 && (u+v) > 0.0 && u > 0.0 && u < 1.0 && v > 0.0 && v < 1.0){
+		return t;
+	}
+	else {
+		return -1.0;
+	}
+}
+
+uniform bool lightType = true;
+
+// reflection budget: at most maxBounces bounces, none once the weight of the
+// next one is below minReflCoeff, and past rouletteDepth bounces a path
+// survives with probability reflCoeff and is reweighted by 1/reflCoeff. The
+// cutoff tests the weight before any reweighting (pathWeight), which survival
+// would otherwise reset to about 1
+uniform int maxBounces = 20;
+uniform float minReflCoeff = 0.0;
+uniform int rouletteDepth = 0;		// 0 disables Russian roulette
+
+// temporal accumulation: frameIndex is the number of frames the host has
+// averaged so far, it picks this frame's random pixel and lens points
+uniform int frameIndex = 0;
+
+// thin lens camera (ENABLE_DOF): lens radius and distance of the plane in
+// focus along the view axis
+uniform float aperture = 0.1;
+uniform float focusDistance = 7.0;
+
+// integer hash (PCG output permutation), used for per pixel random numbers
+#include "sampler.glsl"
+
+uvec2 randomPixel = uvec2(0);		// full resolution pixel being shaded, set by shadePixel()
+
+float random(uint stream){
+	stream += uint(frameIndex) * 0x9E3779B9u;
+	return float(hash(hash(hash(randomPixel.x) ^ randomPixel.y) ^ hash(stream))) / 4294967296.0;
+}
+
+// maps the unit square to the unit disc keeping strata intact (Shirley-Chiu)
+vec2 concentricDisk(vec2 u){
+	u = u * 2.0 - 1.0;
+	if (u.x == 0.0 && u.y == 0.0){
+		return vec2(0.0);
+	}
+	if (abs(u.x) > abs(u.y)){
+		float theta = (PI / 4.0) * (u.y / u.x);
+		return u.x * vec2(cos(theta), sin(theta));
+	}
+	float theta = (PI / 2.0) - (PI / 4.0) * (u.x / u.y);
+	return u.y * vec2(cos(theta), sin(theta));
+}
+
+// distance along lightRay from sectPoint to the closest primitive in front of
+// the light, rayLength when nothing is in the way. The primitive being lit is
+// skipped
+float shadowDistance(vec3 sectPoint, vec3 lightRay, float rayLength, int objType, int currObj){
+	float t;
+	float dist = rayLength;
+	float border = BORDER;
+	for (int j = 0; j < NUM_TRIANGLES; j++){
+		if (!(objType == 0 && currObj == j)){
+			COUNT(counts0.x);
+			t = intersectTriangle(lightRay, TRIANGLES[j], sectPoint);
+		}
+		if (t > border && t <= rayLength && t < dist){
+			dist = t;
+		}
+	}
+	for (int j = 0; j < NUM_SPHERES; j++){
+		if (!(objType == 1 && currObj == j)){
+			COUNT(counts0.y);
+			t = intersectSphere(lightRay, SPHERES[j], sectPoint);
+		}
+		if (t > border && t <= rayLength && t < dist){
+			dist = t;
+		}
+	}
+	for (int j = 0; j < NUM_PLANES; j++){
+		if (!(objType == 2 && currObj == j)){
+			COUNT(counts0.z);
+			t = intersectPlane(lightRay, PLANES[j], sectPoint);
+		}
+		if (t > border && t <= rayLength && t < dist){
+			dist = t;
+		}
+	}
+	return dist;
+}
+
+// normal, colour and Phong exponent of the primitive at sectPoint
+void surface(vec3 sectPoint, int objType, int currObj, out vec3 normal, out vec3 objCol, out float pVal){
+	switch(objType) {
+		case 0 : // triangles
+			normal = TRIANGLES[currObj].normal;
+			objCol = TRIANGLES[currObj].color;
+			pVal = TRIANGLES[currObj].p;
+			break;
+		case 1 : // spheres
+			normal = normalize(sectPoint - SPHERES[currObj].center);
+			objCol = SPHERES[currObj].color;
+			pVal = SPHERES[currObj].p;
+			break;
+		case 2 : // planes
+			normal = PLANES[currObj].normal;
+			objCol = PLANES[currObj].color;
+			pVal = PLANES[currObj].p;
+			break;
+	}
+}
+
+#if MANY_LIGHTS
+// many lights: the lights come from buffer textures and every light falls off
+// with the square of its distance. shadePoint() adds a fixed ambient term to
+// lightSamples lights drawn from the light tree (see lighttree.h) with
+// probability proportional to the estimate lightImportance() makes of their
+// contribution, each weighted by 1 / probability, so the average over frames
+// converges to the sum over every light. lightSamples 0 sums every light
+uniform samplerBuffer lightNodes;
+uniform samplerBuffer lightList;
+uniform int lightSamples = 1;
+const vec3 AMBIENT_LIGHT = vec3(0.1);
+const uint LIGHT_STREAM = 0x20000u;		// random() streams of the light choices
+uint lightStream = LIGHT_STREAM;
+
+// upper bound of power * cos(angle to the normal) / distance^2 over the
+// node's box, the distance clamped to the box's radius
+float lightImportance(int node, vec3 point, vec3 normal){
+	vec4 low = texelFetch(lightNodes, 2 * node);
+	vec3 high = texelFetch(lightNodes, 2 * node + 1).xyz;
+	vec3 toCentre = 0.5 * (low.xyz + high) - point;
+	float radius2 = max(0.25 * dot(high - low.xyz, high - low.xyz), 1e-4);
+	float dist2 = dot(toCentre, toCentre);
+	float cosBound = 1.0;
+	if (dist2 > radius2){
+		// the box is inside a cone of half angle asin(radius / distance)
+		float cosAxis = dot(normal, toCentre) * inversesqrt(dist2);
+		float sinHalf = sqrt(radius2 / dist2);
+		float cosHalf = sqrt(1.0 - radius2 / dist2);
+		if (cosAxis < cosHalf){
+			cosBound = cosAxis * cosHalf + sqrt(max(0.0, 1.0 - cosAxis * cosAxis)) * sinHalf;
+		}
+	}
+	return low.w * max(cosBound, 0.0) / max(dist2, radius2);
+}
+
+// walks the tree from the root to a light, -1 where no light can reach the
+// point. pdf is the probability of the light that was taken
+int sampleLight(vec3 point, vec3 normal, float u, out float pdf){
+	pdf = 1.0;
+	int node = 0;
+	for (int level = 0; level < 64; level++){
+		int child = floatBitsToInt(texelFetch(lightNodes, 2 * node + 1).w);
+		if (child < 0){
+			return -child - 1;
+		}
+		float left = lightImportance(child, point, normal);
+		float right = lightImportance(child + 1, point, normal);
+		if (left + right <= 0.0){
+			return -1;
+		}
+		// u is reused below the choice, rescaled to [0,1)
+		float pLeft = left / (left + right);
+		if (u < pLeft){
+			node = child;
+			pdf *= pLeft;
+			u = u / pLeft;
+		}
+		else {
+			node = child + 1;
+			pdf *= 1.0 - pLeft;
+			u = (u - pLeft) / (1.0 - pLeft);
+		}
+	}
+	return -1;
+}
+
+// diffuse and specular light of light i at sectPoint, with its shadow ray
+vec3 lightContribution(int i, vec3 sectPoint, int objType, int currObj, vec3 dir, vec3 normal, vec3 objCol, float pVal){
+	vec3 ray = texelFetch(lightList, 2 * i).xyz - sectPoint;
+	float rayLength = sqrt(dot(ray, ray));
+	vec3 lightRay = ray / rayLength;
+	float cosine = dot(normal, lightRay);
+	if (cosine <= 0.0){
+		return vec3(0.0);
+	}
+	COUNT(counts0.w);
+	float dist = shadowDistance(sectPoint, lightRay, rayLength, objType, currObj);
+	vec3 intensityDiff = texelFetch(lightList, 2 * i + 1).rgb / max(rayLength * rayLength, 1e-4);
+	vec3 intensitySpec = intensityDiff;
+	if (dist < rayLength){
+		intensityDiff *= (atan(dist * 0.5)/(PI * 0.5));
+		intensitySpec = 0.4 * intensityDiff;
+	}
+	vec3 h = normalize(-dir + lightRay);
+	return objCol * intensityDiff * cosine + intensitySpec * pow(max(0.0, dot(h, normal)), pVal);
+}
+
+vec3 shadePoint(vec3 sectPoint, int objType, int currObj, vec3 dir){
+	vec3 normal;
+	vec3 objCol;
+	float pVal;
+	surface(sectPoint, objType, currObj, normal, objCol, pVal);
+	vec3 retCol = objCol * AMBIENT_LIGHT;
+	if (lightSamples == 0){
+		int count = textureSize(lightList) / 2;
+		for (int i = 0; i < count; i++){
+			retCol += lightContribution(i, sectPoint, objType, currObj, dir, normal, objCol, pVal);
+		}
+		return retCol;
+	}
+	for (int s = 0; s < lightSamples; s++){
+		float pdf;
+		int i = sampleLight(sectPoint, normal, random(lightStream++), pdf);
+		if (i >= 0){
+			retCol += lightContribution(i, sectPoint, objType, currObj, dir, normal, objCol, pVal) / (pdf * float(lightSamples));
+		}
+	}
+	return retCol;
+}
+#endif
+
+#if NUM_AREA_LIGHTS > 0
+// area lights: every light gets areaSamples shadow rays to points on it, one
+// in each cell of a square grid over the light, and the light they see is
+// averaged, so shadows have a penumbra. The point in each cell comes from a
+// blue-noise mask tiled across the screen: neighbouring pixels sample the
+// light in different places and the error looks like fine grain instead of
+// banding. Every frame of an average shifts the points (see blueNoiseSample)
+uniform AreaLight areaLights[NUM_AREA_LIGHTS];
+uniform int areaSamples = 4;		// a square number
+uniform sampler2D blueNoise;		// RGBA8, four independent masks
+int noiseSet = 0;		// sample sets drawn so far by this pixel
+
+// point in the unit square for the next sample set of this pixel. Sets take
+// the masks in turn at offsets that keep them apart, and each frame adds the
+// R2 sequence to them (a Cranley-Patterson rotation), so the frames of an
+// average fill the square evenly and a pixel's sets do not repeat
+vec2 blueNoiseSample(){
+	ivec2 size = textureSize(blueNoise, 0);
+	int set = noiseSet++;
+	ivec2 texel = (ivec2(randomPixel) + (set / 2) * ivec2(23, 41)) % size;
+	vec4 noise = texelFetch(blueNoise, texel, 0);
+	vec2 u = (set % 2 == 0) ? noise.xy : noise.zw;
+	return r2(uint(frameIndex), u);
+}
+
+// point u of the unit square mapped onto the light as seen from point
+vec3 areaLightPoint(AreaLight light, vec3 point, vec2 u){
+	if (light.radius > 0.0){
+		// the disc through the sphere's centre facing the point, which is
+		// close to its outline unless the point is very near
+		vec3 axis = normalize(point - light.centre);
+		vec3 right = normalize(cross(axis, (abs(axis.y) < 0.9) ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+		vec3 up = cross(axis, right);
+		vec2 disk = concentricDisk(u) * light.radius;
+		return light.centre + disk.x * right + disk.y * up;
+	}
+	return light.centre + (u.x - 0.5) * light.edge1 + (u.y - 0.5) * light.edge2;
+}
+
+// the point light shading of the original tracer per sample, with shadows
+// that block the light completely, summed over the lights
+vec3 shadeAreaLights(vec3 sectPoint, int objType, int currObj, vec3 dir){
+	vec3 normal;
+	vec3 objCol;
+	float pVal;
+	surface(sectPoint, objType, currObj, normal, objCol, pVal);
+	int grid = max(int(sqrt(float(areaSamples)) + 0.5), 1);
+	vec3 retCol = vec3(0.0);
+	for (int i = 0; i < NUM_AREA_LIGHTS; i++){
+		bool point = areaLights[i].radius <= 0.0 && areaLights[i].edge1 == vec3(0.0);
+		int samples = point ? 1 : grid * grid;
+		vec2 jitter = blueNoiseSample();
+		vec3 lit = vec3(0.0);
+		for (int s = 0; s < samples; s++){
+			vec2 u = (vec2(s % grid, s / grid) + jitter) / float(grid);
+			vec3 ray = areaLightPoint(areaLights[i], sectPoint, u) - sectPoint;
+			float rayLength = sqrt(dot(ray, ray));
+			vec3 lightRay = ray / rayLength;
+			COUNT(counts0.w);
+			if (shadowDistance(sectPoint, lightRay, rayLength, objType, currObj) < rayLength){
+				continue;
+			}
+			vec3 h = normalize(-dir + lightRay);
+			lit += objCol * max(0.0, dot(normal, lightRay)) + pow(max(0.0, dot(h, normal)), pVal);
+		}
+		retCol += areaLights[i].color * (objCol * 0.2 + lit / float(samples));
+	}
+	return retCol;
+}
+#endif
+
+vec3 getColor(vec3 sectPoint, int objType, int currObj, vec3 dir){
+	//objType: 0 is Triangle, 1 is Sphere, 2 is Plane
+#if NUM_AREA_LIGHTS > 0
+	return shadeAreaLights(sectPoint, objType, currObj, dir);
+#elif MANY_LIGHTS
+	return shadePoint(sectPoint, objType, currObj, dir);
+#else
+	bool shadowed = false;
+	vec3 retCol = vec3(1.0);
+	for (int i = 0; i < lights.length(); i++){
+		vec3 ray = lights[i].pos - sectPoint;
+		vec3 lightRay = normalize(ray);
+		float rayLength = sqrt(dot(ray, ray));
+		COUNT(counts0.w);
+		float dist = shadowDistance(sectPoint, lightRay, rayLength, objType, currObj);
+		if (dist < rayLength){
+			shadowed = true;
+		}
+
+		if (dist < 100000.0){
+			vec3 objCol;
+			vec3 normal;
+			float pVal = 0.0;
+			surface(sectPoint, objType, currObj, normal, objCol, pVal);
+			vec3 intensity = lights[i].color;
+			vec3 intensityDiff = intensity;
+			vec3 intensitySpec = intensity;
+			if (shadowed){
+				intensityDiff *= (atan(dist * 0.5)/(PI * 0.5));
+				intensitySpec = 0.4 * intensityDiff;
+			}
+			vec3 ambient = intensity*0.2;
+			vec3 specular = vec3(1.0);//(specVal)*vec3(1.0) + (1.0 - specVal)*objCol;
+			vec3 h = normalize(-dir + lightRay);
+			vec3 diffuse = objCol * (ambient + (intensityDiff * max(0.0, dot(normal, lightRay))));
+			retCol *= diffuse + (intensitySpec * specular * pow(max(0.0, dot(h,normal)), pVal));
+		}
+		else {
+			COUNT(counts1.y);
+			return vec3(1.0);
+		}
+	}
+	return retCol;
+#endif
+}
+
+vec3 getReflection(vec3 dir, vec3 startColor, float refIndex, vec3 normal, vec3 sectPoint){
+	vec3 retCol = startColor * (1.0 - refIndex);
+	float reflCoeff = refIndex;
+	float pathWeight = refIndex;
+
+	vec3 reflRay;
+
+	vec3 objCol;
+	float objRef;
+	vec3 objNorm;
+	int objType;
+	int iVal;
+
+	float border = BORDER;
+
+	int iter = 0;
+	while ((iter < maxBounces) && (refIndex > 0.0) && (pathWeight >= minReflCoeff)){
+		if (rouletteDepth > 0 && iter >= rouletteDepth){
+			float survive = min(reflCoeff, 1.0);
+			if (random(uint(iter)) >= survive){
+				break;
+			}
+			reflCoeff /= survive;
+		}
+		reflRay = normalize(dir - (2.0 * normal * dot(dir, normal)));
+		float dist = 100000.0;
+
+		float t;
+		COUNT(counts1.x);
+		for (int i = 0; i < NUM_TRIANGLES; i++){
+			COUNT(counts0.x);
+			t = intersectTriangle(reflRay, TRIANGLES[i], sectPoint);
+			if (t > border && t < dist){
+				dist = t;
+				objRef = TRIANGLES[i].ref;
+				objNorm = TRIANGLES[i].normal;
+				objType = 0;
+				iVal = i;
+			}
+		}
+		for (int i = 0; i < NUM_SPHERES; i++){
+			COUNT(counts0.y);
+			t = intersectSphere(reflRay, SPHERES[i], sectPoint);
+			if (t > border && t < dist){
+				dist = t;
+				objRef = SPHERES[i].ref;
+				objNorm = normalize(sectPoint - SPHERES[i].center);
+				objType = 1;
+				iVal = i;
+			}
+		}
+		for (int i = 0; i < NUM_PLANES; i++){
+			COUNT(counts0.z);
+			t = intersectPlane(reflRay, PLANES[i], sectPoint);
+			if (t > border && t < dist){
+				dist = t;
+				objRef = PLANES[i].ref;
+				objNorm = PLANES[i].normal;
+				objType = 2;
+				iVal = i;
+			}
+		}
+		if (dist < 100000.0){
+			dir = reflRay;
+			sectPoint = sectPoint + (dist * dir);
+			normal = objNorm;
+
+			objCol = getColor(sectPoint, objType, iVal, dir);
+			
+			refIndex = objRef;
+			retCol += (objCol * (1.0 - refIndex) * reflCoeff);
+			reflCoeff *= refIndex;
+			pathWeight *= refIndex;
+
+			iter++;
+		}
+		else {
+			COUNT(counts1.y);
+			objCol = vec3(0.0);
+			refIndex = objRef;
+			retCol += (objCol * (1.0 - refIndex) * reflCoeff);
+			return retCol;
+		}
+	}
+	return retCol;
+}
+
+mat3 rotationMatrixY(float theta){
+	return mat3(cos(theta), 0.0, 	sin(theta),
+				0.0,		1.0, 	0.0,
+				-sin(theta), 0.0,	cos(theta));
+}
+
+mat3 rotationMatrixX(float theta){
+	return mat3(1.0,	0.0, 		0.0,
+				0.0,	cos(theta), -sin(theta),
+				0.0,	sin(theta),	cos(theta));
+}
+
+uniform float xRot;
+uniform float yRot;
+
+// progressive refinement: reduced density passes trace the pixel at
+// sampleOffset in every sampleStride x sampleStride block of the full image
+uniform vec2 resolution = vec2(512.0);
+uniform int sampleStride = 1;
+uniform ivec2 sampleOffset = ivec2(0);
+
+// adaptive anti-aliasing: a second pass reads the one sample per pixel image and
+// only traces extra samples where the local luminance deviation is high
+uniform bool adaptivePass = false;
+uniform sampler2D firstPass;
+uniform float aaThreshold = 0.05;
+
+#if ENABLE_REPROJECTION
+// temporal reprojection: the primary hit of every pixel (point and object id + 1,
+// 0 for a miss) is written next to the colour. While the camera moves a hit is
+// projected into the previous frame, and when that pixel saw the same object
+// within 1% of the distance to it, its colour is reused instead of shading the
+// hit again. Highlights follow the eye, so the hit must also be seen from
+// within 1 degree of the previous direction, and mirrors, whose reflections
+// move with the eye, are always traced. One 8x8 pixel tile of every 4x4 tiles
+// (refreshPhase) is always shaded, so stale shading is replaced within 16
+// frames. Whole tiles keep neighbouring pixels on the same path, where single
+// pixels would keep every SIMD group busy shading
+uniform bool reproject = false;
+uniform sampler2D historyColor;
+uniform sampler2D historyHits;
+uniform vec3 historyPos;		// camera of the previous frame
+uniform vec2 historyRot;		// its xRot, yRot
+uniform int refreshPhase = 0;
+const float REUSE_COS = 0.99985;	// cos(1 degree)
+
+vec4 primaryHit = vec4(0.0);
+
+bool reuseHistory(vec3 point, vec3 origin, float id, float reflVal, out vec3 color){
+	ivec2 tile = ivec2(randomPixel) / 8;
+	if (!reproject || (tile.x % 4) + 4 * (tile.y % 4) == refreshPhase){
+		return false;
+	}
+	if (reflVal > 0.0 || dot(normalize(point - historyPos), normalize(point - origin)) < REUSE_COS){
+		return false;
+	}
+
+	// inverse of tracePixel() for the previous camera
+	vec3 view = rotationMatrixX(historyRot.x) * rotationMatrixY(historyRot.y) * (point - historyPos);
+	if (view.z >= 0.0){
+		return false;
+	}
+	float focal = -1.0 / tan(FOV * 0.5);
+	vec2 pixelPos = view.xy * (focal / view.z);
+	pixelPos.x /= resolution.x / resolution.y;
+	ivec2 previous = ivec2(floor((pixelPos * 0.5 + 0.5) * resolution));
+	if (any(lessThan(previous, ivec2(0))) || any(greaterThanEqual(previous, ivec2(resolution)))){
+		return false;
+	}
+
+	vec4 hit = texelFetch(historyHits, previous, 0);
+	if (hit.w != id || distance(hit.xyz, point) > 0.01 * distance(point, historyPos)){
+		return false;
+	}
+	color = texelFetch(historyColor, previous, 0).rgb;
+	return true;
+}
+#endif
+
+#if ENABLE_GBUFFER
+// primary visibility rasterized by gbuffer.glsl: per pixel the hit point and
+// id (objType * 1024 + index + 1, 0 where no triangle or sphere covers the
+// pixel centre). shadePixel() looks up its pixel's id for the pixel centre
+// ray, -2 leaves the search to the loops
+uniform sampler2D gbuffer;
+int rasterizedId = -2;
+
+int gbufferId(ivec2 pixel){
+	return int(texelFetch(gbuffer, pixel, 0).w) - 1;
+}
+
+// intersects the ray with the rasterized primitive only, false where the
+// G-buffer can't be used or the ray misses that primitive (at its edges)
+bool rasterizedHit(vec3 dir, vec3 origin, inout int objType, inout int iVal, inout float reflVal, inout vec3 normal){
+	if (rasterizedId < 0){
+		return rasterizedId == -1;
+	}
+	objType = rasterizedId / 1024;
+	iVal = rasterizedId % 1024;
+	if (objType == 0){
+		COUNT(counts0.x);
+		minDist = intersectTriangle(dir, TRIANGLES[iVal], origin);
+		reflVal = TRIANGLES[iVal].ref;
+		normal = TRIANGLES[iVal].normal;
+	}
+	else {
+		COUNT(counts0.y);
+		minDist = intersectSphere(dir, SPHERES[iVal], origin);
+		reflVal = SPHERES[iVal].ref;
+		normal = normalize((origin + (minDist*dir)) - SPHERES[iVal].center);
+	}
+	if (minDist <= 0.0){
+		minDist = 100000.0;
+		return false;
+	}
+	return true;
+}
+#endif
+
+#if ENABLE_TILE_LISTS
+// screen-space binning: the host projects the bounds of every triangle and
+// sphere into TILE_SIZE x TILE_SIZE pixel tiles and lists per tile the ones
+// that can cover it, triangles first, in index order. tileRanges holds each
+// tile's offset and length in tilePrimitives (ids objType * 1024 + index).
+// shadePixel() picks its pixel's tile for the primary rays
+uniform isampler2D tileRanges;
+uniform isamplerBuffer tilePrimitives;
+uniform bool showTileLists = false;		// colour pixels by their tile's list length
+const int TILE_SIZE = 16;
+int tileOffset = 0;
+int tileCount = -1;		// -1 searches everything
+
+// intersects the ray with the primitives of its tile only, in the same order
+// as the loops in getClosestIntersection() so ties resolve the same way
+bool binnedHit(vec3 dir, vec3 origin, inout int objType, inout int iVal, inout float reflVal, inout vec3 normal){
+	if (tileCount < 0){
+		return false;
+	}
+	float t;
+	for (int k = 0; k < tileCount; k++){
+		int id = texelFetch(tilePrimitives, tileOffset + k).r;
+		int i = id % 1024;
+		if (id < 1024){
+			COUNT(counts0.x);
+			t = intersectTriangle(dir, TRIANGLES[i], origin);
+			if (t > 0.0 && t < minDist){
+				minDist = t;
+				objType = 0;
+				iVal = i;
+				reflVal = TRIANGLES[i].ref;
+				normal = TRIANGLES[i].normal;
+			}
+		}
+		else {
+			COUNT(counts0.y);
+			t = intersectSphere(dir, SPHERES[i], origin);
+			if (t > 0.0 && t < minDist){
+				minDist = t;
+				objType = 1;
+				iVal = i;
+				reflVal = SPHERES[i].ref;
+				normal = normalize((origin + (minDist*dir)) - SPHERES[i].center);
+			}
+		}
+	}
+	return true;
+}
+#endif
+
+#if ENABLE_GBUFFER || ENABLE_TILE_LISTS
+// the shortcuts primary rays can take past the triangle and sphere loops,
+// false where the ray has to search them all
+bool primaryShortcut(vec3 dir, vec3 origin, inout int objType, inout int iVal, inout float reflVal, inout vec3 normal){
+#if ENABLE_GBUFFER
+	if (rasterizedHit(dir, origin, objType, iVal, reflVal, normal)){
+		return true;
+	}
+#endif
+#if ENABLE_TILE_LISTS
+	return binnedHit(dir, origin, objType, iVal, reflVal, normal);
+#else
+	return false;
+#endif
+}
+#endif
+
+vec3 getClosestIntersection(vec3 dir, vec3 origin){
+	vec3 color;
+	float t;
+	int objType;
+	int iVal;
+	float reflVal;
+	vec3 normal;
+	minDist = 100000.0;
+	COUNT(counts1.z);
+#if ENABLE_GBUFFER || ENABLE_TILE_LISTS
+	// triangles and spheres are only searched in full where neither the
+	// G-buffer nor the tile lists apply, the planes are unbounded and always
+	// traced
+	if (!primaryShortcut(dir, origin, objType, iVal, reflVal, normal)){
+#endif
+	for (int i = 0; i < NUM_TRIANGLES; i++){
+		COUNT(counts0.x);
+		t = intersectTriangle(dir, TRIANGLES[i], origin);
+		if (t > 0.0 && t < minDist){
+			minDist = t;
+			objType = 0;
+			iVal = i;
+			reflVal = TRIANGLES[i].ref;
+			normal = TRIANGLES[i].normal;
+		}
+	}
+	for (int i = 0; i < NUM_SPHERES; i++){
+		COUNT(counts0.y);
+		t = intersectSphere(dir, SPHERES[i], origin);
+		if (t > 0.0 && t < minDist){
+			minDist = t;
+			objType = 1;
+			iVal = i;
+			reflVal = SPHERES[i].ref;
+			normal = normalize((origin + (minDist*dir)) - SPHERES[i].center);
+		}
+	}
+#if ENABLE_GBUFFER || ENABLE_TILE_LISTS
+	}
+#endif
+	for (int i = 0; i < NUM_PLANES; i++){
+		COUNT(counts0.z);
+		t = intersectPlane(dir, PLANES[i], origin);
+		if (t > 0.0 && t < minDist){
+			minDist = t;
+			objType = 2;
+			iVal = i;
+			reflVal = PLANES[i].ref;
+			normal = PLANES[i].normal;
+		}
+	}
+	if(minDist < 100000.0){
+		vec3 intersectPoint = origin + (minDist*dir);
+#if ENABLE_REPROJECTION
+		primaryHit = vec4(intersectPoint, float(objType * 1024 + iVal + 1));
+		if (reuseHistory(intersectPoint, origin, primaryHit.w, reflVal, color)){
+			COUNT(counts1.w);
+			return color;
+		}
+#endif
+		color = getColor(intersectPoint, objType, iVal, dir);
+#if ENABLE_REFLECTIONS
+		color = getReflection(dir, color, reflVal, normal, intersectPoint);
+#endif
+		return color;
+	}
+	COUNT(counts1.y);
+	return vec3(0.0);
+}
+
+// traces the primary ray through the given point in [-1,1] screen space, the
+// vertical field of view is kept for non-square images
+vec3 tracePixel(vec2 pixelPos){
+	pixelPos.x *= resolution.x / resolution.y;
+
+	vec3 origin = vec3(0.0, 0.0, 0.0);
+	origin += vec3(xPos, yPos, zPos);
+	//origin *= rotationMatrixY(yRot); // camera doesn't do the thing
+
+	float focal = -1.0 / tan(FOV * 0.5);
+	vec3 direction = normalize(vec3(pixelPos, focal));
+	direction *= rotationMatrixX(xRot) * rotationMatrixY(yRot);
+
+	return getClosestIntersection(direction, origin);
+}
+
+// salts of the pixel and lens sequences' seeds, clear of the bounce numbers
+// Russian roulette uses as random() streams
+const uint SAMPLE_STREAM = 0x10000u;
+
+#if ENABLE_DOF
+// traces the ray from lensPoint (camera space, on the lens plane) through the
+// point of the focal plane the pinhole ray through pixelPos hits, so only
+// that plane is sharp
+vec3 traceLens(vec2 pixelPos, vec2 lensPoint){
+	pixelPos.x *= resolution.x / resolution.y;
+
+	float focal = -1.0 / tan(FOV * 0.5);
+	vec3 focusPoint = vec3(pixelPos, focal) * (focusDistance / -focal);
+	vec3 lens = vec3(lensPoint * aperture, 0.0);
+
+	mat3 rotation = rotationMatrixX(xRot) * rotationMatrixY(yRot);
+	vec3 origin = vec3(xPos, yPos, zPos) + lens * rotation;
+	vec3 direction = normalize(focusPoint - lens) * rotation;
+
+	return getClosestIntersection(direction, origin);
+}
+#endif
+
+float luminance(vec3 color){
+	return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+// standard deviation of luminance over the 3x3 neighbourhood of the first pass
+float localDeviation(ivec2 pixel){
+	// the target is allocated at the full size, only resolution of it is this image
+	ivec2 maxPixel = ivec2(resolution) - 1;
+	float sum = 0.0;
+	float sumSq = 0.0;
+	for (int y = -1; y <= 1; y++){
+		for (int x = -1; x <= 1; x++){
+			ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), maxPixel);
+			float lum = luminance(clamp(texelFetch(firstPass, neighbour, 0).rgb, 0.0, 1.0));
+			sum += lum;
+			sumSq += lum * lum;
+		}
+	}
+	float mean = sum / 9.0;
+	return sqrt(max(0.0, sumSq / 9.0 - mean * mean));
+}
+
+// averages a grid x grid stratified set of samples over the pixel
+vec3 supersample(ivec2 pixel, int grid){
+	vec3 sum = vec3(0.0);
+	for (int y = 0; y < grid; y++){
+		for (int x = 0; x < grid; x++){
+			vec2 subPixel = (vec2(x, y) + 0.5) / float(grid);
+			sum += tracePixel((vec2(pixel) + subPixel) / resolution * 2.0 - 1.0);
+		}
+	}
+	return sum / float(grid * grid);
+}
+
+// colour of the given pixel of the full image for the current pass, before the
+// clamping in shadePixel()
+vec4 pixelColor(ivec2 pixel){
+	// seeded by the image pixel, so reduced density passes draw the same
+	// numbers as a full trace
+	randomPixel = uvec2(pixel);
+	vec2 pixelPos = (vec2(pixel) + 0.5) / resolution * 2.0 - 1.0;
+
+#if ENABLE_TILE_LISTS
+	// the lists are padded by a pixel, so they hold for the jittered and
+	// supersampled rays of the pixel as well
+	ivec2 range = texelFetch(tileRanges, pixel / TILE_SIZE, 0).xy;
+	tileOffset = range.x;
+	tileCount = range.y;
+	if (showTileLists){
+		// black-red-yellow-white up to every triangle and sphere, as heatmap.png
+		float t = float(tileCount) / float(max(NUM_TRIANGLES + NUM_SPHERES, 1));
+		return vec4(clamp(3.0 * t - vec3(0.0, 1.0, 2.0), 0.0, 1.0), 1.0);
+	}
+#endif
+
+	if (adaptivePass){
+		// flat regions keep their single sample, edges get 4 or 16
+		float deviation = localDeviation(pixel);
+		if (deviation < aaThreshold){
+			return texelFetch(firstPass, pixel, 0);
+		}
+		int grid = (deviation < 4.0 * aaThreshold) ? 2 : 4;
+		return vec4(supersample(pixel, grid), 1.0);
+	}
+
+#if ENABLE_GBUFFER
+	// the G-buffer was rasterized for the pixel centres. Along silhouettes
+	// rasterization and the ray test can disagree on thin or edge-on
+	// primitives, so pixels next to a different id search in full
+	if (frameIndex == 0){
+		rasterizedId = gbufferId(pixel);
+		ivec2 maxPixel = ivec2(resolution) - 1;
+		if (gbufferId(min(pixel + ivec2(1, 0), maxPixel)) != rasterizedId ||
+		    gbufferId(max(pixel - ivec2(1, 0), ivec2(0))) != rasterizedId ||
+		    gbufferId(min(pixel + ivec2(0, 1), maxPixel)) != rasterizedId ||
+		    gbufferId(max(pixel - ivec2(0, 1), ivec2(0))) != rasterizedId){
+			rasterizedId = -2;
+		}
+	}
+#endif
+
+	// the first frame of an average goes through the pixel centre, later ones
+	// through the points of a Sobol sequence scrambled for this pixel, so the
+	// average is anti-aliased
+	if (frameIndex > 0){
+		vec2 jitter = sobolOwen2(uint(frameIndex), pixelSeed(randomPixel, SAMPLE_STREAM)) - 0.5;
+		pixelPos += jitter * 2.0 / resolution;
+	}
+
+#if ENABLE_DOF
+	// a sequence of its own, the lens and pixel points are independent
+	vec2 lensPoint = concentricDisk(sobolOwen2(uint(frameIndex), pixelSeed(randomPixel, SAMPLE_STREAM + 2u)));
+	return vec4(traceLens(pixelPos, lensPoint), 1.0);
+#else
+	return vec4(tracePixel(pixelPos), 1.0);
+#endif
+}
+
+// the targets hold floats for the averages of sampled lights (MANY_LIGHTS),
+// other scenes are averaged in [0,1] as in the 8-bit targets they had before
+vec4 shadePixel(ivec2 pixel){
+#if MANY_LIGHTS
+	return pixelColor(pixel);
+#else
+	return clamp(pixelColor(pixel), 0.0, 1.0);
+#endif
+}
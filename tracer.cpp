@@ -0,0 +1,423 @@
+// ==========================================================================
+// CPU port of the ray tracer in fragment.glsl
+// ==========================================================================
+
+#include <cmath>
+#include <algorithm>
+#include "tracer.h"
+
+using namespace glm;
+
+namespace {
+
+const float PI_F = 3.1415926535897932384626433832795f;
+const float FOV = PI_F/3.f;
+const float NO_HIT = 100000.f;
+
+mat3 rotationMatrixY(float theta){
+	return mat3(cos(theta), 0.f, 	sin(theta),
+				0.f,		1.f, 	0.f,
+				-sin(theta), 0.f,	cos(theta));
+}
+
+mat3 rotationMatrixX(float theta){
+	return mat3(1.f,	0.f, 		0.f,
+				0.f,	cos(theta), -sin(theta),
+				0.f,	sin(theta),	cos(theta));
+}
+
+vec3 normalTriangle(const Triangle &triangle){
+	return cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0);
+}
+
+//Epsilon on secondary rays, scene 3 was tuned without one
+float border(const Scene &scene){
+	return scene.scene3 ? 0.f : 0.001f;
+}
+
+//Distance to the closest object between sectPoint and the light, rayLength
+//if nothing is in the way
+float shadowDistance(const Scene &scene, vec3 sectPoint, vec3 lightRay, float rayLength, int objType, int currObj){
+	float t;
+	float dist = rayLength;
+	float eps = border(scene);
+	for (int j = 0; j < (int)scene.triangles.size(); j++){
+		if (objType == 0 && currObj == j)
+			continue;
+		t = intersectTriangle(lightRay, scene.triangles[j], sectPoint);
+		if (t > eps && t <= rayLength && t < dist)
+			dist = t;
+	}
+	for (int j = 0; j < (int)scene.spheres.size(); j++){
+		if (objType == 1 && currObj == j)
+			continue;
+		t = intersectSphere(lightRay, scene.spheres[j], sectPoint);
+		if (t > eps && t <= rayLength && t < dist)
+			dist = t;
+	}
+	for (int j = 0; j < (int)scene.planes.size(); j++){
+		if (objType == 2 && currObj == j)
+			continue;
+		t = intersectPlane(lightRay, scene.planes[j], sectPoint);
+		if (t > eps && t <= rayLength && t < dist)
+			dist = t;
+	}
+	return dist;
+}
+
+//Normal, colour and Phong exponent of the primitive at sectPoint
+void surface(const Scene &scene, vec3 sectPoint, int objType, int currObj, vec3 &normal, vec3 &objCol, float &pVal){
+	switch(objType) {
+		case 0 : // triangles
+			normal = normalize(normalTriangle(scene.triangles[currObj]));
+			objCol = scene.triangles[currObj].color;
+			pVal = scene.triangles[currObj].p;
+			break;
+		case 1 : // spheres
+			normal = normalize(sectPoint - scene.spheres[currObj].center);
+			objCol = scene.spheres[currObj].color;
+			pVal = scene.spheres[currObj].p;
+			break;
+		default : // planes
+			normal = normalize(scene.planes[currObj].normal);
+			objCol = scene.planes[currObj].color;
+			pVal = scene.planes[currObj].p;
+			break;
+	}
+}
+
+//Scenes with more than one light, as the MANY_LIGHTS path of trace.glsl with
+//lightSamples 0: every light falls off with the square of its distance and
+//is summed, on top of a fixed ambient term
+vec3 shadeLights(const Scene &scene, vec3 sectPoint, int objType, int currObj, vec3 dir){
+	vec3 normal;
+	vec3 objCol;
+	float pVal;
+	surface(scene, sectPoint, objType, currObj, normal, objCol, pVal);
+	vec3 retCol = objCol * 0.1f;
+	for (const Light &light : scene.lights){
+		vec3 ray = light.pos - sectPoint;
+		float rayLength = sqrt(dot(ray, ray));
+		vec3 lightRay = ray / rayLength;
+		float cosine = dot(normal, lightRay);
+		if (cosine <= 0.f)
+			continue;
+		float dist = shadowDistance(scene, sectPoint, lightRay, rayLength, objType, currObj);
+		vec3 intensityDiff = light.color / std::max(rayLength * rayLength, 1e-4f);
+		vec3 intensitySpec = intensityDiff;
+		if (dist < rayLength){
+			intensityDiff *= (atan(dist * 0.5f)/(PI_F * 0.5f));
+			intensitySpec = 0.4f * intensityDiff;
+		}
+		vec3 h = normalize(-dir + lightRay);
+		retCol += objCol * intensityDiff * cosine + intensitySpec * pow(std::max(0.f, dot(h, normal)), pVal);
+	}
+	return retCol;
+}
+
+//objType: 0 is Triangle, 1 is Sphere, 2 is Plane
+vec3 getColor(const Scene &scene, vec3 sectPoint, int objType, int currObj, vec3 dir){
+	if (scene.lights.size() > 1)
+		return shadeLights(scene, sectPoint, objType, currObj, dir);
+
+	bool shadowed = false;
+	vec3 retCol = vec3(1.f);
+	for (unsigned i = 0; i < scene.lights.size(); i++){
+		vec3 ray = scene.lights[i].pos - sectPoint;
+		vec3 lightRay = normalize(ray);
+		float rayLength = sqrt(dot(ray, ray));
+		float dist = shadowDistance(scene, sectPoint, lightRay, rayLength, objType, currObj);
+		if (dist < rayLength)
+			shadowed = true;
+
+		if (dist < NO_HIT){
+			vec3 objCol;
+			vec3 normal;
+			float pVal = 0.f;
+			surface(scene, sectPoint, objType, currObj, normal, objCol, pVal);
+			vec3 intensity = scene.lights[i].color;
+			vec3 intensityDiff = intensity;
+			vec3 intensitySpec = intensity;
+			if (shadowed){
+				intensityDiff *= (atan(dist * 0.5f)/(PI_F * 0.5f));
+				intensitySpec = 0.4f * intensityDiff;
+			}
+			vec3 ambient = intensity*0.2f;
+			vec3 specular = vec3(1.f);
+			vec3 h = normalize(-dir + lightRay);
+			vec3 diffuse = objCol * (ambient + (intensityDiff * std::max(0.f, dot(normal, lightRay))));
+			retCol *= diffuse + (intensitySpec * specular * pow(std::max(0.f, dot(h,normal)), pVal));
+		}
+		else {
+			return vec3(1.f);
+		}
+	}
+	return retCol;
+}
+
+struct RayState{
+	vec3 dir;
+	vec3 normal;
+	vec3 sectPoint;
+	vec3 retCol;
+	float refIndex;
+	float reflCoeff;
+	int pixel;
+};
+
+//One reflection bounce, returns false once the ray is finished
+bool reflectStep(const Scene &scene, RayState &ray){
+	float eps = border(scene);
+	vec3 reflRay = normalize(ray.dir - (2.f * ray.normal * dot(ray.dir, ray.normal)));
+	float dist = NO_HIT;
+	float objRef = 0.f;
+	vec3 objNorm;
+	int objType = 0;
+	int iVal = 0;
+
+	float t;
+	for (int i = 0; i < (int)scene.triangles.size(); i++){
+		t = intersectTriangle(reflRay, scene.triangles[i], ray.sectPoint);
+		if (t > eps && t < dist){
+			dist = t;
+			objRef = scene.triangles[i].ref;
+			objNorm = normalize(normalTriangle(scene.triangles[i]));
+			objType = 0;
+			iVal = i;
+		}
+	}
+	for (int i = 0; i < (int)scene.spheres.size(); i++){
+		t = intersectSphere(reflRay, scene.spheres[i], ray.sectPoint);
+		if (t > eps && t < dist){
+			dist = t;
+			objRef = scene.spheres[i].ref;
+			//same as fragment.glsl: taken from the ray start, not the hit point
+			objNorm = normalize(ray.sectPoint - scene.spheres[i].center);
+			objType = 1;
+			iVal = i;
+		}
+	}
+	for (int i = 0; i < (int)scene.planes.size(); i++){
+		t = intersectPlane(reflRay, scene.planes[i], ray.sectPoint);
+		if (t > eps && t < dist){
+			dist = t;
+			objRef = scene.planes[i].ref;
+			objNorm = normalize(scene.planes[i].normal);
+			objType = 2;
+			iVal = i;
+		}
+	}
+	if (dist >= NO_HIT)
+		return false;
+
+	ray.dir = reflRay;
+	ray.sectPoint = ray.sectPoint + (dist * ray.dir);
+	ray.normal = objNorm;
+
+	vec3 objCol = getColor(scene, ray.sectPoint, objType, iVal, ray.dir);
+
+	ray.refIndex = objRef;
+	ray.retCol += (objCol * (1.f - ray.refIndex) * ray.reflCoeff);
+	ray.reflCoeff *= ray.refIndex;
+	return ray.refIndex > 0.f;
+}
+
+
+//Closest hit of a primary ray, sets up ray for the reflection bounces.
+//Returns false if nothing is hit
+bool primaryHit(const Scene &scene, vec3 dir, vec3 origin, RayState &ray){
+	float t;
+	float minDist = NO_HIT;
+	int objType = 0;
+	int iVal = 0;
+	float reflVal = 0.f;
+	vec3 normal;
+	for (int i = 0; i < (int)scene.triangles.size(); i++){
+		t = intersectTriangle(dir, scene.triangles[i], origin);
+		if (t > 0.f && t < minDist){
+			minDist = t;
+			objType = 0;
+			iVal = i;
+			reflVal = scene.triangles[i].ref;
+			normal = normalize(normalTriangle(scene.triangles[i]));
+		}
+	}
+	for (int i = 0; i < (int)scene.spheres.size(); i++){
+		t = intersectSphere(dir, scene.spheres[i], origin);
+		if (t > 0.f && t < minDist){
+			minDist = t;
+			objType = 1;
+			iVal = i;
+			reflVal = scene.spheres[i].ref;
+			normal = normalize((origin + (minDist*dir)) - scene.spheres[i].center);
+		}
+	}
+	for (int i = 0; i < (int)scene.planes.size(); i++){
+		t = intersectPlane(dir, scene.planes[i], origin);
+		if (t > 0.f && t < minDist){
+			minDist = t;
+			objType = 2;
+			iVal = i;
+			reflVal = scene.planes[i].ref;
+			normal = normalize(scene.planes[i].normal);
+		}
+	}
+	if (minDist >= NO_HIT)
+		return false;
+
+	vec3 intersectPoint = origin + (minDist*dir);
+	vec3 color = getColor(scene, intersectPoint, objType, iVal, dir);
+
+	ray.dir = dir;
+	ray.normal = normal;
+	ray.sectPoint = intersectPoint;
+	ray.retCol = color * (1.f - reflVal);
+	ray.refIndex = reflVal;
+	ray.reflCoeff = reflVal;
+	return true;
+}
+}
+
+float intersectPlane(vec3 dir, const Plane &plane, vec3 start){
+	vec3 disp = plane.point - start;
+	float numer = dot(plane.normal, disp);
+	float denom = dot(dir, plane.normal);
+	if (denom == 0.f){
+		return -1.f;
+	}
+	return numer/denom;
+}
+
+float intersectSphere(vec3 dir, const Sphere &sphere, vec3 start){
+	float a = dot(dir, dir);
+	float b = 2.f * (dot(start, dir) - dot(sphere.center, dir));
+	float c = (-2.f*dot(start, sphere.center)) + dot(start, start) + dot(sphere.center, sphere.center) - (sphere.radius * sphere.radius);
+	float discriminant = b*b - 4.f*a*c;
+	if (discriminant < 0.f){
+		return -1.f;
+	}
+	//same grouping as fragment.glsl, a is 1 for the normalized rays used
+	float t1 = (-b + sqrt(discriminant)) / 2.f*a;
+	float t2 = (-b - sqrt(discriminant)) / 2.f*a;
+	float retVal = std::min(t1,t2);
+	if (retVal < 0.f){
+		retVal = std::max(t1,t2);
+	}
+	return retVal;
+}
+
+float intersectTriangle(vec3 dir, const Triangle &triangle, vec3 start){
+	vec3 s = start - triangle.p0;
+	vec3 e1 = triangle.p1 - triangle.p0;
+	vec3 e2 = triangle.p2 - triangle.p0;
+
+	float tNumer = determinant(mat3(s,e1,e2));
+	float uNumer = determinant(mat3(-dir,s,e2));
+	float vNumer = determinant(mat3(-dir,e1,s));
+	float denom = 1.f/determinant(mat3(-dir,e1,e2));
+
+	float t = tNumer * denom;
+	float u = uNumer * denom;
+	float v = vNumer * denom;
+
+	if ((u+v) < 1.f && (u+v) > 0.f && u > 0.f && u < 1.f && v > 0.f && v < 1.f){
+		return t;
+	}
+	return -1.f;
+}
+
+vec3 traceRay(const Scene &scene, vec3 dir, vec3 origin){
+	RayState ray;
+	if (!primaryHit(scene, dir, origin, ray))
+		return vec3(0.f);
+	for (int iter = 0; iter < 20 && ray.refIndex > 0.f; iter++){
+		if (!reflectStep(scene, ray))
+			break;
+	}
+	return ray.retCol;
+}
+
+mat3 cameraRotation(const Camera &camera){
+	return rotationMatrixX(camera.xRot) * rotationMatrixY(camera.yRot);
+}
+
+vec2 projectPoint(vec3 view){
+	float focal = -1.f / tan(FOV * 0.5f);
+	return vec2(view) * (focal / view.z);
+}
+
+vec3 tracePixel(const Scene &scene, const Camera &camera, vec2 pixelPos){
+	float focal = -1.f / tan(FOV * 0.5f);
+	//GLSL's vector * matrix is the transpose of glm's matrix * vector
+	vec3 direction = normalize(vec3(pixelPos, focal)) * (rotationMatrixX(camera.xRot) * rotationMatrixY(camera.yRot));
+	return traceRay(scene, direction, camera.pos);
+}
+
+// --------------------------------------------------------------------------
+// Tile rendering
+//
+// Tiles are traced breadth first: all primary rays of the tile, then one
+// reflection bounce for every ray still alive, and so on. Each step of the
+// queue is one reflectStep, the same bounce traceRay runs in a loop, so the
+// result matches traceRay pixel for pixel.
+
+
+void renderTile(const Scene &scene, const Camera &camera, int width, int height,
+		int x0, int y0, int w, int h, unsigned char *rgb, int rowStride, Arena &arena){
+	int count = w*h;
+	vec3 *colors = arena.allocArray<vec3>(count);
+	RayState *queue = arena.allocArray<RayState>(count);
+	int active = 0;
+
+	float focal = -1.f / tan(FOV * 0.5f);
+	mat3 rotation = rotationMatrixX(camera.xRot) * rotationMatrixY(camera.yRot);
+
+	//primary rays
+	for (int row = 0; row < h; row++){
+		for (int col = 0; col < w; col++){
+			//image rows run top to bottom, gl_FragCoord.y bottom to top
+			int x = x0 + col;
+			int y = height - 1 - (y0 + row);
+			vec2 pixelPos = (vec2(x, y) + 0.5f) / vec2(width, height) * 2.f - 1.f;
+			pixelPos.x *= float(width) / float(height);
+			vec3 dir = normalize(vec3(pixelPos, focal)) * rotation;
+			int pixel = row*w + col;
+
+			RayState &ray = queue[active];
+			if (!primaryHit(scene, dir, camera.pos, ray)){
+				colors[pixel] = vec3(0.f);
+				continue;
+			}
+			ray.pixel = pixel;
+			if (ray.refIndex > 0.f)
+				active++;
+			else
+				colors[pixel] = ray.retCol;
+		}
+	}
+
+	//reflection bounces, compacting the queue as rays finish
+	for (int iter = 0; iter < 20 && active > 0; iter++){
+		int alive = 0;
+		for (int i = 0; i < active; i++){
+			RayState ray = queue[i];
+			if (reflectStep(scene, ray))
+				queue[alive++] = ray;
+			else
+				colors[ray.pixel] = ray.retCol;
+		}
+		active = alive;
+	}
+	for (int i = 0; i < active; i++)
+		colors[queue[i].pixel] = queue[i].retCol;
+
+	for (int row = 0; row < h; row++){
+		unsigned char *out = rgb + row*rowStride;
+		for (int col = 0; col < w; col++){
+			vec3 color = clamp(colors[row*w + col], 0.f, 1.f);
+			out[3*col] = (unsigned char)(color.r*255.f + 0.5f);
+			out[3*col + 1] = (unsigned char)(color.g*255.f + 0.5f);
+			out[3*col + 2] = (unsigned char)(color.b*255.f + 0.5f);
+		}
+	}
+}
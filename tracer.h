@@ -0,0 +1,46 @@
+// ==========================================================================
+// CPU port of the ray tracer in fragment.glsl
+//
+// Used where no GL context is available (distributed workers). The functions
+// follow their GLSL counterparts line for line so both paths produce the same
+// image for the same scene and camera.
+// ==========================================================================
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "glm/glm.hpp"
+#include "scene.h"
+#include "arena.h"
+
+struct Camera{
+	glm::vec3 pos;
+	float xRot;		//Look up/down, lookUp in main.cpp
+	float yRot;		//Look left/right, lookRight in main.cpp
+};
+
+float intersectPlane(glm::vec3 dir, const Plane &plane, glm::vec3 start);
+float intersectSphere(glm::vec3 dir, const Sphere &sphere, glm::vec3 start);
+float intersectTriangle(glm::vec3 dir, const Triangle &triangle, glm::vec3 start);
+
+//Colour seen along a primary ray, including shadows and reflections
+glm::vec3 traceRay(const Scene &scene, glm::vec3 dir, glm::vec3 origin);
+
+//Colour of the pixel at pixelPos in screen space (y up, [-1,1] vertically,
+//x scaled by the image aspect ratio)
+glm::vec3 tracePixel(const Scene &scene, const Camera &camera, glm::vec2 pixelPos);
+
+//Rotation from world to camera space, the inverse of the primary ray rotation
+glm::mat3 cameraRotation(const Camera &camera);
+
+//The pixelPos tracePixel() traces through a camera space point in front of the
+//camera (z < 0)
+glm::vec2 projectPoint(glm::vec3 view);
+
+//Traces the w x h tile at (x0, y0) of a width x height image into rgb, which
+//holds rows of rowStride bytes (top row first, same orientation as the PNG
+//files written by stb). Per-ray scratch comes from arena, which the caller
+//resets between tiles.
+void renderTile(const Scene &scene, const Camera &camera, int width, int height,
+		int x0, int y0, int w, int h, unsigned char *rgb, int rowStride, Arena &arena);
+
+#endif